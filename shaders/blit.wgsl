@@ -0,0 +1,35 @@
+@group(0) @binding(0) var source: texture_2d<f32>;
+@group(0) @binding(1) var sourceSampler: sampler;
+
+struct VertexOutput {
+  @builtin(position) position: vec4f,
+  @location(0) fragUV: vec2<f32>,
+};
+
+@fragment
+fn fs_main(@location(0) fragUV: vec2<f32>) -> @location(0) vec4f {
+    return textureSampleLevel(source, sourceSampler, fragUV, 0.0);
+}
+
+@vertex
+fn vs_main(
+    @builtin(vertex_index) VertexIndex: u32
+) -> VertexOutput {
+    var pos = array(
+        vec2(-1.0, 3),
+        vec2(3, -1.0),
+        vec2(-1.0, -1.0)
+    );
+
+    // Texture coordinates grow downwards
+    var uv = array(
+        vec2(0.0, -1.0),
+        vec2(2.0, 1.0),
+        vec2(0.0, 1.0),
+    );
+
+    var output: VertexOutput;
+    output.position = vec4(pos[VertexIndex], 0.0, 1.0);
+    output.fragUV = uv[VertexIndex];
+    return output;
+}
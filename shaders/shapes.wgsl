@@ -0,0 +1,142 @@
+// Shapes binned into screen tiles, see ShapeRenderer. cs_bin lists for every
+// tile the shapes whose bounds touch it, fs_main evaluates only those.
+
+const TILE_SIZE: u32 = 16;
+
+struct Params {
+    size: vec2u,
+    tiles: vec2u,
+    shapeCount: u32,
+    maxPerTile: u32,
+    pad: vec2u,
+    background: vec4f,
+};
+
+// Matches Shape in shapes.cppm
+struct Shape {
+    transform: vec4f,
+    offset: vec2f,
+    kind: u32,
+    edge: f32,
+    params: vec4f,
+    bounds: vec4f,
+    color: vec4f,
+};
+
+@group(0) @binding(0) var<uniform> params: Params;
+@group(0) @binding(1) var<storage, read> shapes: array<Shape>;
+// Per tile the count, then the shape indices in paint order
+@group(0) @binding(2) var<storage, read_write> binTiles: array<u32>;
+@group(0) @binding(3) var<storage, read> tiles: array<u32>;
+
+fn sdBox(p: vec2f, b: vec2f) -> f32 {
+    var d: vec2f = abs(p) - b;
+    return length(max(d, vec2(0.0, 0.0))) + min(max(d.x, d.y), 0.0);
+}
+
+fn sdVesica(p: vec2f, r: f32, d: f32) -> f32 {
+    let p1 = abs(p);
+    let b = sqrt(r * r - d * d);
+    if (p1.y - b) * d > p1.x * b {
+        return length(p1 - vec2(0.0, b));
+    } else {
+        return length(p1 - vec2(-d, 0.0)) - r;
+    }
+}
+
+fn dot2(v: vec2f) -> f32 { return dot(v, v); }
+fn sdRoundedCross(p: vec2f, h: f32) -> f32 {
+    let k = 0.5 * (h + 1.0 / h);
+
+    let p1 = abs(p);
+
+    if p1.x < 1.0 && p1.y < p1.x * (k - h) + h {
+        return k - sqrt(dot2(p1 - vec2(1, k)));
+    } else {
+        return sqrt(min(dot2(p1 - vec2(0, h)), dot2(p1 - vec2(1, 0))));
+    }
+}
+
+fn sdEgg(p: vec2f, he: f32, ra: f32, rb: f32) -> f32 {
+    let ce = 0.5 * (he * he - (ra - rb) * (ra - rb)) / (ra - rb);
+
+    let p1 = vec2(abs(p.x), p.y);
+
+    if p1.y < 0.0 {
+        return length(p1) - ra;
+    }
+    if p1.y * ce - p1.x * he > he * ce { return length(vec2(p1.x, p1.y - he)) - rb;}
+    return length(vec2(p1.x + ce, p1.y)) - (ce + ra);
+}
+
+fn sdCircle(p: vec2f, r: f32) -> f32 {
+    return length(p) - r;
+}
+
+fn shapeDistance(shape: Shape, p: vec2f) -> f32 {
+    let q = shape.params;
+    switch shape.kind {
+        case 0u: { return sdBox(p, q.xy); }
+        case 1u: { return sdCircle(p, q.x); }
+        case 2u: { return sdVesica(p, q.x, q.y); }
+        case 3u: { return sdEgg(p, q.x, q.y, q.z); }
+        default: { return sdRoundedCross(p, q.x) - q.y; }
+    }
+}
+
+// One invocation per tile walks all shapes in order, so the lists keep the
+// paint order without atomics
+@compute @workgroup_size(8, 8)
+fn cs_bin(@builtin(global_invocation_id) id: vec3u) {
+    if id.x >= params.tiles.x || id.y >= params.tiles.y {
+        return;
+    }
+
+    // uv grows upwards, pixel rows downwards
+    let size = vec2f(params.size);
+    let low = vec2u(id.x * TILE_SIZE, min((id.y + 1) * TILE_SIZE, params.size.y));
+    let high = vec2u(min((id.x + 1) * TILE_SIZE, params.size.x), id.y * TILE_SIZE);
+    let tileMin = vec2(f32(low.x) / size.x, 1.0 - f32(low.y) / size.y);
+    let tileMax = vec2(f32(high.x) / size.x, 1.0 - f32(high.y) / size.y);
+
+    let base = (id.y * params.tiles.x + id.x) * (params.maxPerTile + 1);
+    var count = 0u;
+    for (var i = 0u; i < params.shapeCount && count < params.maxPerTile; i++) {
+        let bounds = shapes[i].bounds;
+        if all(bounds.xy <= tileMax) && all(bounds.zw >= tileMin) {
+            binTiles[base + 1 + count] = i;
+            count++;
+        }
+    }
+    binTiles[base] = count;
+}
+
+@vertex
+fn vs_main(@builtin(vertex_index) VertexIndex: u32) -> @builtin(position) vec4f {
+    var pos = array(
+        vec2(-1.0, 3),
+        vec2(3, -1.0),
+        vec2(-1.0, -1.0)
+    );
+    return vec4(pos[VertexIndex], 0.0, 1.0);
+}
+
+@fragment
+fn fs_main(@builtin(position) position: vec4f) -> @location(0) vec4f {
+    let size = vec2f(params.size);
+    let uv = vec2(position.x / size.x, 1.0 - position.y / size.y);
+
+    let tile = vec2u(position.xy) / TILE_SIZE;
+    let base = (tile.y * params.tiles.x + tile.x) * (params.maxPerTile + 1);
+    let count = tiles[base];
+
+    var c = params.background.rgb;
+    for (var i = 0u; i < count; i++) {
+        let shape = shapes[tiles[base + 1 + i]];
+        let p = mat2x2f(shape.transform.xy, shape.transform.zw) * uv + shape.offset;
+        let coverage = 1 - smoothstep(0.0, shape.edge, shapeDistance(shape, p));
+        c = mix(c, shape.color.rgb, coverage * shape.color.a);
+    }
+
+    return vec4f(c, 1);
+}
@@ -0,0 +1,461 @@
+export module allocator;
+
+import <algorithm>;
+import <bit>;
+import <cstdint>;
+import <vector>;
+
+// Two-level segregated fit allocator over an abstract range of offsets. It only
+// does the bookkeeping, the memory itself (usually a GPU buffer) lives elsewhere.
+// All sizes and offsets are multiples of the granularity given at construction.
+export class TlsfAllocator
+{
+public:
+    static constexpr uint32_t invalid = 0xffffffffu;
+
+    struct Allocation
+    {
+        uint32_t block = invalid;
+        uint64_t offset = 0;
+        uint64_t size = 0;
+
+        explicit operator bool() const
+        {
+            return block != invalid;
+        }
+    };
+
+    struct Move
+    {
+        uint32_t block;
+        uint64_t sourceOffset;
+        uint64_t destinationOffset;
+        uint64_t size;
+    };
+
+    struct Stats
+    {
+        uint64_t capacity;
+        uint64_t used;
+        uint64_t largestFree;
+        uint32_t allocations;
+        uint32_t freeBlocks;
+
+        // 0 when all free space is one block, towards 1 as it gets scattered
+        float Fragmentation() const
+        {
+            const uint64_t free = capacity - used;
+            return free == 0 ? 0.0f : 1.0f - static_cast<float>(largestFree) / static_cast<float>(free);
+        }
+    };
+
+    TlsfAllocator()
+    {
+        Reset();
+    }
+
+    TlsfAllocator(uint64_t capacity, uint64_t inGranularity)
+    {
+        granularity = inGranularity;
+        capacityUnits = static_cast<uint32_t>(capacity / granularity);
+        Reset();
+    }
+
+    Allocation Allocate(uint64_t size)
+    {
+        if (size == 0)
+        {
+            return {};
+        }
+
+        const uint64_t units64 = (size + granularity - 1) / granularity;
+        if (units64 > capacityUnits)
+        {
+            return {};
+        }
+        const uint32_t units = static_cast<uint32_t>(units64);
+
+        const uint32_t blockIndex = FindFree(units);
+        if (blockIndex == invalid)
+        {
+            return {};
+        }
+
+        RemoveFree(blockIndex);
+
+        if (blocks[blockIndex].size > units)
+        {
+            const uint32_t rest = NewBlock();
+            Block &block = blocks[blockIndex];
+            blocks[rest].offset = block.offset + units;
+            blocks[rest].size = block.size - units;
+            blocks[rest].prevPhysical = blockIndex;
+            blocks[rest].nextPhysical = block.nextPhysical;
+            if (block.nextPhysical != invalid)
+            {
+                blocks[block.nextPhysical].prevPhysical = rest;
+            }
+            block.nextPhysical = rest;
+            block.size = units;
+            InsertFree(rest);
+        }
+
+        blocks[blockIndex].used = true;
+        usedUnits += units;
+        allocationCount++;
+
+        return {blockIndex, static_cast<uint64_t>(blocks[blockIndex].offset) * granularity, static_cast<uint64_t>(units) * granularity};
+    }
+
+    void Free(uint32_t blockIndex)
+    {
+        if (blockIndex >= blocks.size() || !blocks[blockIndex].used)
+        {
+            return;
+        }
+
+        Block &block = blocks[blockIndex];
+        block.used = false;
+        usedUnits -= block.size;
+        allocationCount--;
+
+        uint32_t merged = blockIndex;
+
+        const uint32_t next = block.nextPhysical;
+        if (next != invalid && IsFree(next))
+        {
+            RemoveFree(next);
+            Absorb(merged, next);
+        }
+
+        const uint32_t prev = blocks[merged].prevPhysical;
+        if (prev != invalid && IsFree(prev))
+        {
+            RemoveFree(prev);
+            Absorb(prev, merged);
+            merged = prev;
+        }
+
+        InsertFree(merged);
+    }
+
+    void Free(const Allocation &allocation)
+    {
+        Free(allocation.block);
+    }
+
+    // Current offset of an allocation, which only changes through Defragment.
+    uint64_t Offset(uint32_t blockIndex) const
+    {
+        return static_cast<uint64_t>(blocks[blockIndex].offset) * granularity;
+    }
+
+    uint64_t Size(uint32_t blockIndex) const
+    {
+        return static_cast<uint64_t>(blocks[blockIndex].size) * granularity;
+    }
+
+    // Packs every live allocation towards offset 0 in address order, leaving one
+    // free block at the end. Block indices stay valid; the returned moves tell
+    // the owner which ranges to copy, in an order that never overwrites a source
+    // range before it was read.
+    std::vector<Move> Defragment()
+    {
+        std::vector<Move> moves;
+        std::vector<uint32_t> live;
+
+        for (uint32_t index = head; index != invalid; index = blocks[index].nextPhysical)
+        {
+            if (blocks[index].used)
+            {
+                live.push_back(index);
+            }
+        }
+
+        std::vector<Block> previous = blocks;
+        Reset(false);
+
+        uint32_t offset = 0;
+        uint32_t prev = invalid;
+        for (uint32_t index : live)
+        {
+            Block &block = blocks[index];
+            block = previous[index];
+            if (block.offset != offset)
+            {
+                moves.push_back({index, static_cast<uint64_t>(block.offset) * granularity, static_cast<uint64_t>(offset) * granularity, static_cast<uint64_t>(block.size) * granularity});
+            }
+            block.offset = offset;
+            block.prevPhysical = prev;
+            block.nextPhysical = invalid;
+            block.prevFree = block.nextFree = invalid;
+            if (prev != invalid)
+            {
+                blocks[prev].nextPhysical = index;
+            }
+            else
+            {
+                head = index;
+            }
+            offset += block.size;
+            usedUnits += block.size;
+            allocationCount++;
+            prev = index;
+        }
+
+        // Block slots not used by live allocations become reusable
+        for (uint32_t index = 0; index < blocks.size(); ++index)
+        {
+            if (!blocks[index].used)
+            {
+                blocks[index] = {};
+                blocks[index].nextFree = unusedHead;
+                unusedHead = index;
+            }
+        }
+
+        if (offset < capacityUnits)
+        {
+            const uint32_t tail = NewBlock();
+            blocks[tail].offset = offset;
+            blocks[tail].size = capacityUnits - offset;
+            blocks[tail].prevPhysical = prev;
+            if (prev != invalid)
+            {
+                blocks[prev].nextPhysical = tail;
+            }
+            else
+            {
+                head = tail;
+            }
+            InsertFree(tail);
+        }
+
+        return moves;
+    }
+
+    Stats GetStats() const
+    {
+        Stats stats{static_cast<uint64_t>(capacityUnits) * granularity, static_cast<uint64_t>(usedUnits) * granularity, 0, allocationCount, 0};
+
+        for (uint32_t index = head; index != invalid; index = blocks[index].nextPhysical)
+        {
+            if (!blocks[index].used)
+            {
+                stats.freeBlocks++;
+                stats.largestFree = std::max(stats.largestFree, static_cast<uint64_t>(blocks[index].size) * granularity);
+            }
+        }
+
+        return stats;
+    }
+
+    uint64_t Capacity() const
+    {
+        return static_cast<uint64_t>(capacityUnits) * granularity;
+    }
+
+    uint64_t Granularity() const
+    {
+        return granularity;
+    }
+
+private:
+    static constexpr uint32_t secondLevelBits = 4;
+    static constexpr uint32_t secondLevelCount = 1u << secondLevelBits;
+    static constexpr uint32_t firstLevelCount = 32 - secondLevelBits + 1;
+
+    struct Block
+    {
+        uint32_t offset = 0;
+        uint32_t size = 0;
+        uint32_t prevPhysical = invalid;
+        uint32_t nextPhysical = invalid;
+        uint32_t prevFree = invalid;
+        uint32_t nextFree = invalid;
+        bool used = false;
+    };
+
+    void Reset(bool withFreeBlock = true)
+    {
+        head = invalid;
+        unusedHead = invalid;
+        usedUnits = 0;
+        allocationCount = 0;
+        firstLevelBitmap = 0;
+        for (uint32_t fl = 0; fl < firstLevelCount; ++fl)
+        {
+            secondLevelBitmaps[fl] = 0;
+            for (uint32_t sl = 0; sl < secondLevelCount; ++sl)
+            {
+                freeHeads[fl][sl] = invalid;
+            }
+        }
+
+        if (withFreeBlock)
+        {
+            blocks.clear();
+            if (capacityUnits > 0)
+            {
+                head = NewBlock();
+                blocks[head].size = capacityUnits;
+                InsertFree(head);
+            }
+        }
+    }
+
+    static void Mapping(uint32_t size, uint32_t &fl, uint32_t &sl)
+    {
+        if (size < secondLevelCount)
+        {
+            fl = 0;
+            sl = size;
+        }
+        else
+        {
+            const uint32_t log2 = static_cast<uint32_t>(std::bit_width(size)) - 1;
+            sl = (size >> (log2 - secondLevelBits)) - secondLevelCount;
+            fl = log2 - secondLevelBits + 1;
+        }
+    }
+
+    uint32_t FindFree(uint32_t size) const
+    {
+        // Round up so any block in the found list is large enough
+        uint32_t searchSize = size;
+        if (size >= secondLevelCount)
+        {
+            const uint32_t log2 = static_cast<uint32_t>(std::bit_width(size)) - 1;
+            const uint64_t rounded = static_cast<uint64_t>(size) + (1u << (log2 - secondLevelBits)) - 1;
+            if (rounded > 0xffffffffu)
+            {
+                return FindFreeLinear(size);
+            }
+            searchSize = static_cast<uint32_t>(rounded);
+        }
+
+        uint32_t fl, sl;
+        Mapping(searchSize, fl, sl);
+
+        uint32_t slMap = sl < 32 ? secondLevelBitmaps[fl] & (~0u << sl) : 0;
+        if (slMap == 0)
+        {
+            const uint32_t flMap = fl + 1 < 32 ? firstLevelBitmap & (~0u << (fl + 1)) : 0;
+            if (flMap == 0)
+            {
+                return FindFreeLinear(size);
+            }
+            fl = static_cast<uint32_t>(std::countr_zero(flMap));
+            slMap = secondLevelBitmaps[fl];
+        }
+        sl = static_cast<uint32_t>(std::countr_zero(slMap));
+
+        return freeHeads[fl][sl];
+    }
+
+    // Rounding up can skip the only list holding a block that fits exactly
+    uint32_t FindFreeLinear(uint32_t size) const
+    {
+        uint32_t fl, sl;
+        Mapping(size, fl, sl);
+        for (uint32_t index = freeHeads[fl][sl]; index != invalid; index = blocks[index].nextFree)
+        {
+            if (blocks[index].size >= size)
+            {
+                return index;
+            }
+        }
+        return invalid;
+    }
+
+    bool IsFree(uint32_t index) const
+    {
+        return !blocks[index].used;
+    }
+
+    void InsertFree(uint32_t index)
+    {
+        uint32_t fl, sl;
+        Mapping(blocks[index].size, fl, sl);
+
+        Block &block = blocks[index];
+        block.prevFree = invalid;
+        block.nextFree = freeHeads[fl][sl];
+        if (block.nextFree != invalid)
+        {
+            blocks[block.nextFree].prevFree = index;
+        }
+        freeHeads[fl][sl] = index;
+        firstLevelBitmap |= 1u << fl;
+        secondLevelBitmaps[fl] |= 1u << sl;
+    }
+
+    void RemoveFree(uint32_t index)
+    {
+        uint32_t fl, sl;
+        Mapping(blocks[index].size, fl, sl);
+
+        Block &block = blocks[index];
+        if (block.prevFree != invalid)
+        {
+            blocks[block.prevFree].nextFree = block.nextFree;
+        }
+        else
+        {
+            freeHeads[fl][sl] = block.nextFree;
+        }
+        if (block.nextFree != invalid)
+        {
+            blocks[block.nextFree].prevFree = block.prevFree;
+        }
+        block.prevFree = block.nextFree = invalid;
+
+        if (freeHeads[fl][sl] == invalid)
+        {
+            secondLevelBitmaps[fl] &= ~(1u << sl);
+            if (secondLevelBitmaps[fl] == 0)
+            {
+                firstLevelBitmap &= ~(1u << fl);
+            }
+        }
+    }
+
+    // Merges the physically following block into target and recycles its slot
+    void Absorb(uint32_t target, uint32_t next)
+    {
+        blocks[target].size += blocks[next].size;
+        blocks[target].nextPhysical = blocks[next].nextPhysical;
+        if (blocks[next].nextPhysical != invalid)
+        {
+            blocks[blocks[next].nextPhysical].prevPhysical = target;
+        }
+
+        blocks[next] = {};
+        blocks[next].nextFree = unusedHead;
+        unusedHead = next;
+    }
+
+    uint32_t NewBlock()
+    {
+        if (unusedHead != invalid)
+        {
+            const uint32_t index = unusedHead;
+            unusedHead = blocks[index].nextFree;
+            blocks[index] = {};
+            return index;
+        }
+        blocks.push_back({});
+        return static_cast<uint32_t>(blocks.size() - 1);
+    }
+
+    std::vector<Block> blocks;
+    uint32_t freeHeads[firstLevelCount][secondLevelCount];
+    uint32_t secondLevelBitmaps[firstLevelCount] = {};
+    uint32_t firstLevelBitmap = 0;
+    uint32_t head = invalid;
+    uint32_t unusedHead = invalid;
+    uint32_t capacityUnits = 0;
+    uint32_t usedUnits = 0;
+    uint32_t allocationCount = 0;
+    uint64_t granularity = 1;
+};
@@ -13,6 +13,9 @@ export module app;
 #include <emscripten.h>
 #endif // __EMSCRIPTEN__
 
+import <algorithm>;
+import <array>;
+import <span>;
 import <vector>;
 import <thread>;
 import <atomic>;
@@ -21,9 +24,32 @@ import <filesystem>;
 import <fstream>;
 import <sstream>;
 import <string>;
+import <utility>;
 
 import input;
+import input_replay;
 import loader;
+import release_queue;
+import dynamic_resolution;
+import frame_pacing;
+import frame_sync;
+import gpu_timer;
+import render_targets;
+import resources;
+import buffer_pool;
+import staging_belt;
+import sdf_scene;
+import shape_renderer;
+import shapes;
+import static_pass;
+import capabilities;
+import jobs;
+import mesh_streaming;
+import asset_io;
+import camera;
+import culling;
+import latency;
+import logging;
 
 namespace fs = std::filesystem;
 // #define GLM_ENABLE_EXPERIMENTAL
@@ -45,16 +71,47 @@ struct FrameUniforms
 // Avoid the "wgpu::" prefix in front of all WebGPU symbols
 using namespace wgpu;
 
+export enum class LogoRenderer
+{
+    // main.wgsl, every shape for every pixel
+    Shader,
+    // Shapes binned into screen tiles, see ShapeRenderer
+    Tiled,
+    // WGSL generated from LogoScene
+    Generated,
+};
+
 class ShaderManager
 {
 public:
-    ShaderManager(std::string shaderRootPath)
+    // Shaders come from the archive when one is mounted, otherwise from the
+    // loose source directory.
+    ShaderManager(const AssetReader &assetReader, std::string shaderRootPath)
     {
         rootPath = shaderRootPath;
+
+        if (assetReader.Mounted())
+        {
+            assetReader.ForEachPacked("resources/shaders", [this](const fs::path &path, const AssetView &view)
+                                      { shaderMap[path.filename().string()] = view.Text(); });
+            return;
+        }
+
+        std::vector<fs::path> paths;
         for (const auto &entry : std::filesystem::recursive_directory_iterator(shaderRootPath))
         {
-            const auto path = entry.path().string();
-            UpdateShader(path);
+            if (entry.is_regular_file())
+            {
+                paths.push_back(entry.path());
+            }
+        }
+
+        // Read all shaders in one batch instead of one file after another
+        std::vector<std::string> sources;
+        AssetReader::ReadBatch(paths, sources);
+        for (size_t i = 0; i < paths.size(); ++i)
+        {
+            shaderMap[paths[i].filename().string()] = std::move(sources[i]);
         }
     }
 
@@ -62,14 +119,14 @@ public:
     {
         const auto relativePath = fs::path(shaderLocation).filename().string();
 
-        std::ifstream file(shaderLocation);
-        file.seekg(0, std::ios::end);
-        size_t size = file.tellg();
-        std::string shaderSource(size, ' ');
-        file.seekg(0);
-        file.read(shaderSource.data(), size);
+        MappedFile file;
+        if (!file.Open(shaderLocation))
+        {
+            LogError("Cannot open shader [{}]", shaderLocation);
+            return;
+        }
 
-        shaderMap[relativePath] = shaderSource;
+        shaderMap[relativePath] = file.Text();
     }
 
     std::string GetShader(std::string shaderName)
@@ -77,6 +134,18 @@ public:
         return shaderMap[shaderName];
     }
 
+    // Generated shaders are looked up like the loaded ones, by a name of
+    // their own, and kept so they are generated once
+    void AddGenerated(const std::string &shaderName, std::string source)
+    {
+        shaderMap[shaderName] = std::move(source);
+    }
+
+    bool HasShader(const std::string &shaderName) const
+    {
+        return shaderMap.contains(shaderName);
+    }
+
 private:
     std::map<std::string, std::string> shaderMap;
     std::string rootPath;
@@ -88,6 +157,19 @@ export class App
 public:
     App() {};
 
+    // Frames the CPU may record ahead of the GPU (1 to 3), read by Initialize.
+    // Fewer means less latency, more keeps the GPU busy through CPU hitches.
+    uint32_t framesInFlight = 2;
+    // Read by Initialize, an unsupported present mode falls back to the
+    // closest one, see ChoosePresentMode. A frame rate of 0 is uncapped.
+    PresentMode presentMode = PresentMode::Fifo;
+    double targetFrameRate = 0.0;
+    // Scales the scene resolution to keep its GPU time within budget, the
+    // result is upscaled to the surface
+    ResolutionController resolution;
+    // How the logo is drawn, read by Initialize
+    LogoRenderer logoRenderer = LogoRenderer::Generated;
+
     void Start()
     {
         while (IsRunning())
@@ -98,53 +180,50 @@ public:
         Terminate();
     };
 
-    void Resize(int newWidth, int newHeight)
+    // Writes the consumed input to a file, call before Initialize
+    bool RecordInput(const fs::path &path)
     {
-        if (newWidth == 0 || newWidth == 0)
-        {
-            return;
-        }
-
-        config.width = newWidth;
-        config.height = newHeight;
+        return inputRecorder.Open(path);
+    }
 
-        std::vector<uint32_t> res = {(uint32_t)newWidth, (uint32_t)newHeight};
+    // Drives the input from a recording instead of the window, call before
+    // Initialize. The app closes when the recording ends.
+    bool ReplayInput(const fs::path &path)
+    {
+        return inputReplay.Open(path);
+    }
 
-        if (depthTexture)
+    // Switches present modes at runtime, after Initialize
+    void SetPresentMode(PresentMode mode)
+    {
+        presentMode = mode;
+        config.presentMode = ChoosePresentMode(mode, supportedPresentModes);
+        LogInfo("Present mode: {} (requested {})", PresentModeName(config.presentMode), PresentModeName(mode));
+        if (!minimized)
         {
-            depthTexture.destroy();
-            depthTexture.release();
+            surface.configure(config);
         }
+    }
+
+    void SetTargetFrameRate(double framesPerSecond)
+    {
+        targetFrameRate = framesPerSecond;
+        framePacer.SetTargetRate(framesPerSecond);
+    }
 
-        if (depthTextureView)
+    // Reconfigures the surface for a new framebuffer size, a zero size means
+    // the window is minimized and nothing is rendered until it comes back.
+    // Window callbacks only record the size, see RequestResize.
+    void Resize(int newWidth, int newHeight)
+    {
+        minimized = newWidth == 0 || newHeight == 0;
+        if (minimized)
         {
-            depthTextureView.release();
+            return;
         }
 
-        // Create the depth texture
-        TextureDescriptor depthTextureDesc;
-        depthTextureDesc.dimension = TextureDimension::_2D;
-        depthTextureDesc.format = depthTextureFormat;
-        depthTextureDesc.mipLevelCount = 1;
-        depthTextureDesc.sampleCount = 1;
-        depthTextureDesc.size = {res[0], res[1], 1};
-        depthTextureDesc.usage = TextureUsage::RenderAttachment;
-        depthTextureDesc.viewFormatCount = 1;
-        depthTextureDesc.viewFormats = (WGPUTextureFormat *)&depthTextureFormat;
-        depthTexture = device.createTexture(depthTextureDesc);
-        std::cout << "Depth texture: " << depthTexture << std::endl;
-
-        // Create the view of the depth texture manipulated by the rasterizer
-        TextureViewDescriptor depthTextureViewDesc;
-        depthTextureViewDesc.aspect = TextureAspect::DepthOnly;
-        depthTextureViewDesc.baseArrayLayer = 0;
-        depthTextureViewDesc.arrayLayerCount = 1;
-        depthTextureViewDesc.baseMipLevel = 0;
-        depthTextureViewDesc.mipLevelCount = 1;
-        depthTextureViewDesc.dimension = TextureViewDimension::_2D;
-        depthTextureViewDesc.format = depthTextureFormat;
-        depthTextureView = depthTexture.createView(depthTextureViewDesc);
-        std::cout << "Depth texture view: " << depthTextureView << std::endl;
+        config.width = newWidth;
+        config.height = newHeight;
 
         float ratio = static_cast<float>(newWidth) / static_cast<float>(newHeight);
         float focalLength = 2.0;
@@ -157,11 +236,8 @@ public:
             0.0, 0.0, farr * divider, -farr * nearr * divider,
             0.0, 0.0, 1.0 / focalLength, 0.0));
 
-        queue.writeBuffer(sporadicUniformBuffer, 0, res.data(), 8);
-
         surface.configure(config);
-
-        MainLoop();
+        LogDebug("Surface resized to {}x{}", newWidth, newHeight);
     };
 
     bool Initialize()
@@ -178,7 +254,11 @@ public:
 		// 	} });
 
 
-        shaderManager = new ShaderManager("../../shaders");
+        if (!assetReader.Mount("resources.pak"))
+        {
+            LogInfo("No asset archive, using loose files");
+        }
+        shaderManager = new ShaderManager(assetReader, "../../shaders");
 
         auto width = 640 * 2;
         auto height = width / 2;
@@ -189,7 +269,7 @@ public:
         window = glfwCreateWindow(width, height, "Learn WebGPU", nullptr, nullptr);
         glfwSetWindowUserPointer(window, this);
 
-        input = Input(window);
+        input = Input(window, assetReader);
 
         glfwSetKeyCallback(window, [](GLFWwindow *window, int key, int, int action, int)
                            { static_cast<App *>(glfwGetWindowUserPointer(window))->input.OnKey(key, action); });
@@ -200,51 +280,50 @@ public:
             glfwSetInputMode(window, GLFW_RAW_MOUSE_MOTION, GLFW_TRUE);
 
         glfwSetFramebufferSizeCallback(window, [](GLFWwindow *window, int width, int height)
-                                       { static_cast<App *>(glfwGetWindowUserPointer(window))->Resize(width, height); });
+                                       { static_cast<App *>(glfwGetWindowUserPointer(window))->RequestResize(width, height); });
 
         glfwSetCursorPosCallback(window, [](GLFWwindow *window, double xPos, double yPos)
-                                 { static_cast<App *>(glfwGetWindowUserPointer(window))->input.OnMouseMove(static_cast<float>(xPos), static_cast<float>(yPos)); });
+                                 { static_cast<App *>(glfwGetWindowUserPointer(window))->input.OnMouseMove(xPos, yPos); });
 
-        double xpos, ypos;
-        glfwGetCursorPos(window, &xpos, &ypos);
-
-        oldMouseX = static_cast<float>(xpos);
-        oldMouseY = static_cast<float>(ypos);
+        camera.Bind(input);
 
         Instance instance = wgpuCreateInstance(nullptr);
         surface = glfwGetWGPUSurface(instance, window);
 
-        std::cout << "Requesting adapter..." << std::endl;
+        LogInfo("Requesting adapter...");
 
         RequestAdapterOptions adapterOpts = {};
         adapterOpts.compatibleSurface = surface;
         Adapter adapter = instance.requestAdapter(adapterOpts);
-        std::cout << "Got adapter: " << adapter << std::endl;
+        LogInfo("Got adapter: {}", adapter);
 
         instance.release();
 
-        std::cout << "Requesting device..." << std::endl;
+        LogInfo("Requesting device...");
         DeviceDescriptor deviceDesc = {};
         deviceDesc.label = "My Device";
-        deviceDesc.requiredFeatureCount = 0;
-        RequiredLimits requiredLimits = GetRequiredLimits(adapter);
-        deviceDesc.requiredLimits = &requiredLimits;
+        capabilities = DeviceCapabilities::Negotiate(adapter, requirements);
+        if (!capabilities.Valid())
+        {
+            capabilities.LogErrors();
+            adapter.release();
+            return false;
+        }
+        deviceDesc.requiredFeatureCount = capabilities.features.size();
+        deviceDesc.requiredFeatures = capabilities.features.data();
+        deviceDesc.requiredLimits = &capabilities.requiredLimits;
         deviceDesc.defaultQueue.nextInChain = nullptr;
         deviceDesc.defaultQueue.label = "The default queue";
         deviceDesc.deviceLostCallback = [](WGPUDeviceLostReason reason, char const *message, void * /* pUserData */)
         {
-            std::cout << "Device lost: reason " << reason;
-            if (message)
-                std::cout << " (" << message << ")";
-            std::cout << std::endl;
+            LogWarning("Device lost: reason {} ({})", reason, message);
         };
         device = adapter.requestDevice(deviceDesc);
-        std::cout << "Got device: " << device << std::endl;
+        LogInfo("Got device: {}", device);
+        capabilities.Update(device);
         uncapturedErrorCallbackHandle = device.setUncapturedErrorCallback([](ErrorType type, char const *message)
                                                                           {
-		std::cout << "Uncaptured device error: type " << type;
-		if (message) std::cout << " (" << message << ")";
-		std::cout << std::endl; });
+		LogError("Uncaptured device error: type {} ({})", static_cast<WGPUErrorType>(type), message); });
 
         queue = device.getQueue();
 
@@ -259,23 +338,59 @@ public:
         config.viewFormatCount = 0;
         config.viewFormats = nullptr;
         config.device = device;
-        config.presentMode = PresentMode::Fifo;
         config.alphaMode = CompositeAlphaMode::Auto;
 
+#ifndef __EMSCRIPTEN__
+        SurfaceCapabilities surfaceCapabilities;
+        surface.getCapabilities(adapter, &surfaceCapabilities);
+        supportedPresentModes.assign(surfaceCapabilities.presentModes, surfaceCapabilities.presentModes + surfaceCapabilities.presentModeCount);
+        surfaceCapabilities.freeMembers();
+#endif
+        if (supportedPresentModes.empty())
+        {
+            supportedPresentModes.push_back(PresentMode::Fifo);
+        }
+        config.presentMode = ChoosePresentMode(presentMode, supportedPresentModes);
+        LogInfo("Present mode: {} (requested {})", PresentModeName(config.presentMode), PresentModeName(presentMode));
+        framePacer.SetTargetRate(targetFrameRate);
+
         InitializeLayouts();
         InitializePipeline();
+        InitializeBlitPipelines();
         InitializeBindGroupsAndBuffers();
 
         Resize(width, height);
         adapter.release();
+        Setup();
         return true;
     };
 
 protected:
     // Initialize everything and return true if it went all right
 
+    // Runs once at the end of Initialize, e.g. to resolve input actions
+    virtual void Setup() {}
+
     virtual void Tick() = 0;
+
+    // Runs right before the frame uniforms are written, after the late event
+    // pump, the place to move the camera from input
+    virtual void LateUpdate() {}
+
+    const DeviceCapabilities &Capabilities() const
+    {
+        return capabilities;
+    }
+
     Input input;
+    // Subclasses may raise these before Initialize to enable more features
+    EngineRequirements requirements;
+    // Polls input once the surface texture is acquired instead of at the
+    // start of the frame: the camera gets events that arrived while waiting
+    // for the surface, Tick sees them on the next frame
+    bool lateInputPump = false;
+    // Drives viewMatrix every tick, Tick and LateUpdate may tweak it further
+    CameraController camera;
     mat4x4 viewMatrix = mat4x4(1.0);
 
 private:
@@ -283,6 +398,7 @@ private:
     {
         surface.configure(config);
         InitializePipeline();
+        InitializeBlitPipelines();
         crashed = false;
     };
 
@@ -290,15 +406,55 @@ private:
 
     void Terminate()
     {
-        pipeline.release();
+        inputRecorder.Close();
+
+        // Stats below go straight to the streams, after what is queued
+        Logger::Instance().Flush();
+        resources.PrintStats(std::cout);
+        bufferPool.PrintStats(std::cout);
+        latency.PrintStats(std::cout);
+        frameSync.PrintStats(std::cout);
+        framePacer.PrintStats(std::cout);
+        resolution.PrintStats(std::cout);
+        cullStats.PrintStats(std::cout);
+
+        resources.Release(pipeline);
+        resources.Release(upscalePipeline);
+        resources.Release(upscaleBindGroup);
+        resources.Release(compositePipeline);
+        resources.Release(logoBlitPipeline);
+        resources.Release(logoBindGroup);
+        logoPass.Terminate();
+        shapeRenderer.Terminate();
+        resources.Release(blitSampler);
+        resources.Release(blitLayout);
+        resources.Release(blitBindGroupLayout);
+        resources.Release(sporadicBindGroup);
+        for (Handle<BindGroup> &bindGroup : frameBindGroups)
+        {
+            resources.Release(bindGroup);
+        }
+        resources.Release(layout);
+        resources.Release(sporadicBindGroupLayout);
+        resources.Release(frameBindGroupLayout);
+        meshStreamer.Terminate();
+        bufferPool.Free(sporadicUniformRange);
+        for (BufferRange &range : frameUniformRanges)
+        {
+            bufferPool.Free(range);
+        }
+        bufferPool.Terminate();
+        stagingBelt.Terminate();
+        renderTargets.Terminate();
+        gpuTimer.Terminate();
+
+        resources.ReportLeaks(std::cerr);
+        frameSync.Terminate();
+        releaseQueue.Flush();
+
         queue.release();
         surface.release();
         device.release();
-        sporadicBindGroup.release();
-        frameBindGroup.release();
-        vertexBuffer.release();
-        depthTextureView.release();
-        depthTexture.release();
 
         delete shaderManager;
         glfwTerminate();
@@ -307,34 +463,101 @@ private:
     // Draw a frame and handle events
     void MainLoop()
     {
+        // However many sizes a drag went through, only the last one is applied
+        if (resizePending)
+        {
+            resizePending = false;
+            Resize(pendingWidth, pendingHeight);
+        }
+
+        if (minimized || glfwGetWindowAttrib(window, GLFW_ICONIFIED))
+        {
+            // Nothing to present to, sleep until something happens
+            glfwWaitEvents();
+            return;
+        }
+
+        framePacer.Wait();
+        // Input is sampled only after the wait, a bounded queue of frames
+        // also bounds how old it is once displayed
+        frameSlot = frameSync.BeginFrame(device);
+        // Before anything of the frame is written, see BufferPool::Defragment
+        if (bufferPool.Defragment())
+        {
+            UpdateUniformBindGroups();
+        }
         InternalTick();
         Render();
-        LateTick();
+    }
+
+    void RequestResize(int width, int height)
+    {
+        pendingWidth = width;
+        pendingHeight = height;
+        resizePending = true;
     }
 
     void InternalTick()
     {
-        glfwPollEvents();
+        if (!lateInputPump)
+        {
+            PumpEvents();
+            UpdateCamera();
+        }
         Tick();
     }
 
-    void LateTick()
+    // Starts a new input frame with everything that arrived until now, or
+    // with the next frame of the replay, whose time then becomes frameTime
+    void PumpEvents()
     {
         input.EndFrame();
+        glfwPollEvents();
+
+        if (inputReplay.IsOpen())
+        {
+            input.DiscardEvents();
+            if (!inputReplay.NextFrame(input, frameTime))
+            {
+                LogInfo("Input replay finished after {} frames", inputReplay.Frame());
+                inputReplay.Close();
+                glfwSetWindowShouldClose(window, GLFW_TRUE);
+            }
+            return;
+        }
+
+        frameTime = glfwGetTime();
+        input.ProcessEvents(frameTime);
+        if (inputRecorder.IsOpen())
+        {
+            inputRecorder.WriteFrame(frameTime, input.FrameEvents());
+        }
     }
 
-    void Render()
+    // Once per tick, right after the events it consumes were applied
+    void UpdateCamera()
+    {
+        const double now = frameTime;
+        // Hitches (loading, dragging the window) must not teleport the camera
+        const float deltaTime = lastCameraUpdate > 0.0 ? static_cast<float>(std::min(now - lastCameraUpdate, 0.1)) : 0.0f;
+        lastCameraUpdate = now;
+
+        camera.Update(input, deltaTime);
+        viewMatrix = camera.ViewMatrix();
+    }
+
+    void WriteFrameUniforms(const mat4x4 &modelMatrix)
     {
-        mat4x4 S = glm::scale(mat4x4(1.0), vec3(1.0f));
-        mat4x4 T1 = glm::translate(mat4x4(1.0), vec3(0.0, 0.0, 0.0));
-        mat4x4 R0 = glm::rotate(mat4x4(1.0), glm::mod(-static_cast<float>(glfwGetTime()), glm::two_pi<float>()), vec3(0.0, 1.0, 0.0));
-        mat4x4 R1 = glm::rotate(mat4x4(1.0), -glm::half_pi<float>(), vec3(1.0, 0.0, 0.0));
-        mat4x4 modelMatrix = T1 * R0 * S;
         glm::mat3x4 normalMatrix = glm::mat3x4(glm::inverseTranspose(modelMatrix));
 
-        FrameUniforms uniforms = {normalMatrix, projectionMatrix * viewMatrix * modelMatrix, static_cast<float>(glfwGetTime())};
+        FrameUniforms uniforms = {normalMatrix, projectionMatrix * viewMatrix * modelMatrix, static_cast<float>(frameTime)};
 
-        queue.writeBuffer(frameUniformBuffer, 0, &uniforms, sizeof(FrameUniforms));
+        bufferPool.Write(frameUniformRanges[frameSlot], &uniforms, sizeof(FrameUniforms));
+    }
+
+    void Render()
+    {
+        meshStreamer.Update(MeshStreamer::defaultUploadBudget);
 
         // Get the next target texture view
         Texture target = GetNextSurfaceTexture();
@@ -346,21 +569,75 @@ private:
             return;
         }
 
+        // Late latch: with lateInputPump the events that arrived while waiting
+        // for the surface still move the camera. Everything below, LOD
+        // selection and culling included, sees the same view as the uniforms,
+        // which go into this frame's slot that no frame on the GPU reads.
+        if (lateInputPump)
+        {
+            PumpEvents();
+            UpdateCamera();
+        }
+        LateUpdate();
+
+        mat4x4 S = glm::scale(mat4x4(1.0), vec3(1.0f));
+        mat4x4 T1 = glm::translate(mat4x4(1.0), vec3(0.0, 0.0, 0.0));
+        mat4x4 R0 = glm::rotate(mat4x4(1.0), glm::mod(-static_cast<float>(frameTime), glm::two_pi<float>()), vec3(0.0, 1.0, 0.0));
+        mat4x4 R1 = glm::rotate(mat4x4(1.0), -glm::half_pi<float>(), vec3(1.0, 0.0, 0.0));
+        mat4x4 modelMatrix = T1 * R0 * S;
+        WriteFrameUniforms(modelMatrix);
+
+        // Scene resolution for this frame from the GPU times measured so far,
+        // without timestamp queries it stays at full resolution
+        double gpuMilliseconds = 0.0;
+        if (gpuTimer.TakePassTime(gpuMilliseconds))
+        {
+            resolution.Update(gpuMilliseconds);
+        }
+        const RenderSize sceneSize = resolution.Size(config.width, config.height);
+        const bool upscale = sceneSize != RenderSize{config.width, config.height};
+        if (sceneSize != renderSize)
+        {
+            renderSize = sceneSize;
+            const uint32_t res[2] = {sceneSize.width, sceneSize.height};
+            bufferPool.Write(sporadicUniformRange, res, 8);
+        }
+
+        // At full resolution the scene goes straight to the surface
+        RenderTarget sceneTarget;
+        if (upscale)
+        {
+            sceneTarget = renderTargets.Acquire(device, sceneSize.width, sceneSize.height, surfaceFormat,
+                                                TextureUsage::RenderAttachment | TextureUsage::TextureBinding, TextureAspect::All, "Scene color");
+        }
+
         // Create a command encoder for the draw call
         CommandEncoderDescriptor encoderDesc = {};
         encoderDesc.label = "My command encoder";
         CommandEncoder encoder = wgpuDeviceCreateCommandEncoder(device, &encoderDesc);
 
+        // Uploads staged since the last frame land before anything draws
+        stagingBelt.Flush(encoder);
+
+        // The logo only depends on the surface size, it is redrawn after a
+        // resize or a shader reload and sampled otherwise
+        if (logoPass.Update(device, encoder, config.width, config.height))
+        {
+            LogDebug("Logo rendered at {}x{} ({} times)", config.width, config.height, logoPass.Renders());
+        }
+
         // Create the render pass that clears the screen with our color
         RenderPassDescriptor renderPassDesc = {};
 
         // The attachment part of the render pass descriptor describes the target texture of the pass
         RenderPassColorAttachment renderPassColorAttachment = {};
-        renderPassColorAttachment.view = targetView;
+        renderPassColorAttachment.view = upscale ? resources.Get(sceneTarget.view) : targetView;
         renderPassColorAttachment.resolveTarget = nullptr;
         renderPassColorAttachment.loadOp = LoadOp::Clear;
         renderPassColorAttachment.storeOp = StoreOp::Store;
-        renderPassColorAttachment.clearValue = WGPUColor{0.4, 0.1, 0.2, 1.0};
+        // A scaled scene goes over the logo in the upscale pass, it starts
+        // transparent and stays premultiplied
+        renderPassColorAttachment.clearValue = upscale && logoPass.View() ? WGPUColor{0.0, 0.0, 0.0, 0.0} : WGPUColor{0.4, 0.1, 0.2, 1.0};
 #ifndef WEBGPU_BACKEND_WGPU
         renderPassColorAttachment.depthSlice = WGPU_DEPTH_SLICE_UNDEFINED;
 #endif // NOT WEBGPU_BACKEND_WGPU
@@ -368,11 +645,15 @@ private:
         renderPassDesc.colorAttachmentCount = 1;
         renderPassDesc.colorAttachments = &renderPassColorAttachment;
 
+        // Same size as the scene, the cache hands back the one used last frame
+        const RenderTarget depthTarget = renderTargets.Acquire(device, sceneSize.width, sceneSize.height, depthTextureFormat, TextureUsage::RenderAttachment,
+                                                               TextureAspect::DepthOnly, "Depth texture");
+
         {
             // We now add a depth/stencil attachment:
             RenderPassDepthStencilAttachment depthStencilAttachment;
             // The view of the depth texture
-            depthStencilAttachment.view = depthTextureView;
+            depthStencilAttachment.view = resources.Get(depthTarget.view);
 
             // The initial value of the depth buffer, meaning "far"
             depthStencilAttachment.depthClearValue = 1.0f;
@@ -396,22 +677,72 @@ private:
             renderPassDesc.depthStencilAttachment = &depthStencilAttachment;
         }
 
-        renderPassDesc.timestampWrites = nullptr;
+        // The scene pass is what scales with resolution, only it is measured
+        renderPassDesc.timestampWrites = gpuTimer.PassWrites();
 
         // Create the render pass and end it immediately (we only clear the screen but do not draw anything)
         RenderPassEncoder renderPass = encoder.beginRenderPass(renderPassDesc);
 
         // Select which render pipeline to use
-        renderPass.setPipeline(pipeline);
-        renderPass.setVertexBuffer(0, vertexBuffer, 0, vertexBufferSize);
-        renderPass.setBindGroup(0, frameBindGroup, 0, nullptr);
-        renderPass.setBindGroup(1, sporadicBindGroup, 0, nullptr);
+        // Logo background first, one texture fetch per pixel. It has the
+        // surface's size, a scaled scene gets it in the upscale pass instead.
+        if (logoPass.View() && !upscale)
+        {
+            UpdateBlitBindGroup(logoBindGroup, logoSource, logoPass.View());
+            renderPass.setPipeline(resources.Get(compositePipeline));
+            renderPass.setBindGroup(0, resources.Get(logoBindGroup), 0, nullptr);
+            renderPass.draw(3, 1, 0, 0);
+        }
 
-        // Draw 1 instance of a 3-vertices shape
-        renderPass.draw(vertexCount, 1, 0, 0);
+        renderPass.setPipeline(resources.Get(pipeline));
+        renderPass.setBindGroup(0, resources.Get(frameBindGroups[frameSlot]), 0, nullptr);
+        renderPass.setBindGroup(1, resources.Get(sporadicBindGroup), 0, nullptr);
+
+        // Meshes still streaming in are simply skipped
+        MeshDrawInfo drawInfo;
+        if (meshStreamer.GetDrawInfo(mesh, drawInfo))
+        {
+            renderPass.setVertexBuffer(0, drawInfo.vertexBuffer, drawInfo.vertexOffset, drawInfo.vertexSize);
+            renderPass.setIndexBuffer(drawInfo.indexBuffer, IndexFormat::Uint32, drawInfo.indexOffset, drawInfo.indexSize);
+
+            // Only clusters facing the camera inside the frustum are drawn
+            drawRanges.clear();
+            const vec3 cameraPosition = vec3(glm::inverse(viewMatrix)[3]);
+
+            // Distant meshes use a coarser level, picked by projected error
+            std::span<const Loader::Meshlet> meshlets = drawInfo.meshlets;
+            DrawRange whole = {0, drawInfo.indexCount};
+            if (!drawInfo.lods.empty())
+            {
+                const uint32_t level = SelectLod(drawInfo.lods, modelMatrix, cameraPosition, projectionMatrix, static_cast<float>(sceneSize.height));
+                const Loader::MeshLod &lod = drawInfo.lods[level];
+                meshlets = meshlets.subspan(lod.firstMeshlet, lod.meshletCount);
+                whole = {lod.firstIndex, lod.indexCount};
+            }
+
+            if (meshlets.empty())
+            {
+                drawRanges.push_back(whole);
+            }
+            else
+            {
+                CullMeshlets(meshlets, modelMatrix, Frustum(projectionMatrix * viewMatrix), cameraPosition, drawRanges, &cullStats);
+            }
+
+            for (const DrawRange &range : drawRanges)
+            {
+                renderPass.drawIndexed(range.indexCount, 1, range.firstIndex, 0, 0);
+            }
+        }
 
         renderPass.end();
         renderPass.release();
+        gpuTimer.Resolve(encoder);
+
+        if (upscale)
+        {
+            Upscale(encoder, sceneTarget, targetView);
+        }
 
         // Finally encode and submit the render pass
         CommandBufferDescriptor cmdBufferDescriptor = {};
@@ -420,23 +751,95 @@ private:
         encoder.release();
 
         queue.submit(1, &command);
+        const double submitTime = glfwGetTime();
         command.release();
+        releaseQueue.Submit(queue);
+        frameSync.Submit(queue);
+        gpuTimer.Submitted();
+        stagingBelt.Recall();
 
         // At the enc of the frame
 #ifndef __EMSCRIPTEN__
         surface.present();
 #endif
+        framePacer.Presented();
+        // Replayed events carry the recording's times, not this clock's
+        if (!inputReplay.IsOpen())
+        {
+            latency.Record(input.FirstEventTime(), submitTime, glfwGetTime());
+        }
 
         targetView.release();
         target.release();
 
-#if defined(WEBGPU_BACKEND_DAWN)
-        device.tick();
-#elif defined(WEBGPU_BACKEND_WGPU)
-        device.poll(false);
-#endif
+        // Never blocks, waiting for the GPU is left to the next BeginFrame
+        frameSync.Poll(device);
+        releaseQueue.Collect();
     };
 
+    // Points a blit bind group at source, recreating it only when the source
+    // is not the one it was made for
+    void UpdateBlitBindGroup(Handle<BindGroup> &bindGroup, Handle<TextureView> &boundSource, Handle<TextureView> source)
+    {
+        if (bindGroup && source == boundSource)
+        {
+            return;
+        }
+        resources.Release(bindGroup);
+
+        BindGroupEntry bindings[2] = {};
+        bindings[0].binding = 0;
+        bindings[0].textureView = resources.Get(source);
+        bindings[1].binding = 1;
+        bindings[1].sampler = resources.Get(blitSampler);
+
+        BindGroupDescriptor bindGroupDesc{};
+        bindGroupDesc.layout = resources.Get(blitBindGroupLayout);
+        bindGroupDesc.entryCount = 2;
+        bindGroupDesc.entries = bindings;
+        bindGroup = resources.Add(device.createBindGroup(bindGroupDesc), 0, "Blit bind group");
+        boundSource = source;
+    }
+
+    // Stretches the scene over the surface with bilinear filtering, on top of
+    // the logo which is copied at its full resolution
+    void Upscale(CommandEncoder &encoder, const RenderTarget &scene, TextureView targetView)
+    {
+        // The scene target changes with its size
+        UpdateBlitBindGroup(upscaleBindGroup, upscaleSource, scene.view);
+
+        RenderPassColorAttachment colorAttachment = {};
+        colorAttachment.view = targetView;
+        colorAttachment.resolveTarget = nullptr;
+        // Every pixel is overwritten
+        colorAttachment.loadOp = LoadOp::Clear;
+        colorAttachment.storeOp = StoreOp::Store;
+        colorAttachment.clearValue = WGPUColor{0.0, 0.0, 0.0, 1.0};
+#ifndef WEBGPU_BACKEND_WGPU
+        colorAttachment.depthSlice = WGPU_DEPTH_SLICE_UNDEFINED;
+#endif // NOT WEBGPU_BACKEND_WGPU
+
+        RenderPassDescriptor passDesc = {};
+        passDesc.colorAttachmentCount = 1;
+        passDesc.colorAttachments = &colorAttachment;
+        passDesc.depthStencilAttachment = nullptr;
+        passDesc.timestampWrites = nullptr;
+
+        RenderPassEncoder pass = encoder.beginRenderPass(passDesc);
+        if (logoPass.View())
+        {
+            UpdateBlitBindGroup(logoBindGroup, logoSource, logoPass.View());
+            pass.setPipeline(resources.Get(logoBlitPipeline));
+            pass.setBindGroup(0, resources.Get(logoBindGroup), 0, nullptr);
+            pass.draw(3, 1, 0, 0);
+        }
+        pass.setPipeline(resources.Get(upscalePipeline));
+        pass.setBindGroup(0, resources.Get(upscaleBindGroup), 0, nullptr);
+        pass.draw(3, 1, 0, 0);
+        pass.end();
+        pass.release();
+    }
+
     // Return true as long as the main loop should keep on running
     bool IsRunning()
     {
@@ -459,14 +862,14 @@ private:
         BindGroupLayoutDescriptor bindGroupLayoutDesc{};
         bindGroupLayoutDesc.entryCount = 1;
         bindGroupLayoutDesc.entries = &bindingLayout;
-        frameBindGroupLayout = device.createBindGroupLayout(bindGroupLayoutDesc);
+        frameBindGroupLayout = resources.Add(device.createBindGroupLayout(bindGroupLayoutDesc), 0, "Frame bind group layout");
 
         bindingLayout.buffer.minBindingSize = 4 * 2;
         bindingLayout.visibility = ShaderStage::Fragment | ShaderStage::Vertex;
 
-        sporadicBindGroupLayout = device.createBindGroupLayout(bindGroupLayoutDesc);
+        sporadicBindGroupLayout = resources.Add(device.createBindGroupLayout(bindGroupLayoutDesc), 0, "Sporadic bind group layout");
 
-        std::vector<WGPUBindGroupLayout> layouts = {frameBindGroupLayout, sporadicBindGroupLayout};
+        std::vector<WGPUBindGroupLayout> layouts = {resources.Get(frameBindGroupLayout), resources.Get(sporadicBindGroupLayout)};
 
         // Create the pipeline layout
         PipelineLayoutDescriptor pipelineLayoutDesc{};
@@ -474,17 +877,32 @@ private:
         pipelineLayoutDesc.bindGroupLayoutCount = layouts.size();
         pipelineLayoutDesc.bindGroupLayouts = layouts.data();
 
-        layout = device.createPipelineLayout(pipelineLayoutDesc);
+        layout = resources.Add(device.createPipelineLayout(pipelineLayoutDesc), 0, "Pipeline layout");
+
+        // Blits (upscale, logo composite) sample one texture
+        BindGroupLayoutEntry blitEntries[2] = {Default, Default};
+        blitEntries[0].binding = 0;
+        blitEntries[0].visibility = ShaderStage::Fragment;
+        blitEntries[0].texture.sampleType = TextureSampleType::Float;
+        blitEntries[0].texture.viewDimension = TextureViewDimension::_2D;
+        blitEntries[1].binding = 1;
+        blitEntries[1].visibility = ShaderStage::Fragment;
+        blitEntries[1].sampler.type = SamplerBindingType::Filtering;
+
+        bindGroupLayoutDesc.entryCount = 2;
+        bindGroupLayoutDesc.entries = blitEntries;
+        blitBindGroupLayout = resources.Add(device.createBindGroupLayout(bindGroupLayoutDesc), 0, "Blit bind group layout");
+
+        WGPUBindGroupLayout blitLayouts[1] = {resources.Get(blitBindGroupLayout)};
+        pipelineLayoutDesc.bindGroupLayoutCount = 1;
+        pipelineLayoutDesc.bindGroupLayouts = blitLayouts;
+        blitLayout = resources.Add(device.createPipelineLayout(pipelineLayoutDesc), 0, "Blit pipeline layout");
     };
 
     void InitializePipeline()
     {
 
-        if (pipeline)
-        {
-            pipeline.release();
-            pipeline = nullptr;
-        }
+        resources.Release(pipeline);
 
         ShaderModuleDescriptor shaderDesc;
 
@@ -554,8 +972,10 @@ private:
         blendState.color.srcFactor = BlendFactor::SrcAlpha;
         blendState.color.dstFactor = BlendFactor::OneMinusSrcAlpha;
         blendState.color.operation = BlendOperation::Add;
-        blendState.alpha.srcFactor = BlendFactor::Zero;
-        blendState.alpha.dstFactor = BlendFactor::One;
+        // Coverage accumulates in alpha, a transparent cleared scene then
+        // holds premultiplied color for the upscale pass to blend
+        blendState.alpha.srcFactor = BlendFactor::One;
+        blendState.alpha.dstFactor = BlendFactor::OneMinusSrcAlpha;
         blendState.alpha.operation = BlendOperation::Add;
 
         ColorTargetState colorTarget;
@@ -587,133 +1007,213 @@ private:
         pipelineDesc.multisample.mask = ~0u;
         pipelineDesc.multisample.alphaToCoverageEnabled = false;
 
-        pipelineDesc.layout = layout;
+        pipelineDesc.layout = resources.Get(layout);
 
-        pipeline = device.createRenderPipeline(pipelineDesc);
+        pipeline = resources.Add(device.createRenderPipeline(pipelineDesc), 0, "Model pipeline");
 
         shaderModule.release();
     };
 
-    void InitializeBindGroupsAndBuffers()
+    void InitializeBlitPipelines()
     {
-        std::vector<Loader::VertexAttributes> vertexData;
-        Loader::LoadGeometryFromObj("resources/meshes/circle.obj", vertexData);
+        resources.Release(upscalePipeline);
+        resources.Release(compositePipeline);
+        resources.Release(logoBlitPipeline);
+        upscalePipeline = CreateBlitPipeline(false, true, "Upscale pipeline");
+        compositePipeline = CreateBlitPipeline(true, false, "Logo composite pipeline");
+        logoBlitPipeline = CreateBlitPipeline(false, false, "Logo blit pipeline");
+
+        InitializeLogo();
+    }
 
+    void InitializeLogo()
+    {
+        if (logoRenderer == LogoRenderer::Shader)
         {
-            BufferDescriptor bufferDesc;
-            bufferDesc.size = vertexData.size() * sizeof(Loader::VertexAttributes);
-            bufferDesc.usage = BufferUsage::CopyDst | BufferUsage::Vertex;
-            bufferDesc.mappedAtCreation = false;
-            vertexBuffer = device.createBuffer(bufferDesc);
-            vertexBufferSize = bufferDesc.size;
-            vertexCount = static_cast<int>(vertexData.size());
-            queue.writeBuffer(vertexBuffer, 0, vertexData.data(), bufferDesc.size);
+            logoPass.SetShader(device, shaderManager->GetShader("main.wgsl"), surfaceFormat);
+            return;
         }
 
+        if (logoRenderer == LogoRenderer::Tiled)
         {
-            BufferDescriptor bufferDesc;
-            bufferDesc.size = sizeof(FrameUniforms);
-            bufferDesc.usage = BufferUsage::CopyDst | BufferUsage::Uniform;
-            bufferDesc.mappedAtCreation = false;
-            frameUniformBuffer = device.createBuffer(bufferDesc);
+            const SdfScene logo = LogoScene();
+            std::vector<Shape> shapes;
+            if (logo.ToShapes(shapes))
+            {
+                shapeRenderer.Initialize(device, queue, shaderManager->GetShader("shapes.wgsl"), surfaceFormat);
+                shapeRenderer.SetShapes(shapes, logo.background);
+                logoPass.SetDraw(surfaceFormat, [this](CommandEncoder &encoder, TextureView target, uint32_t targetWidth, uint32_t targetHeight)
+                                 { shapeRenderer.Draw(encoder, target, targetWidth, targetHeight); });
+                return;
+            }
+            // Rounding, subtraction and smooth blends have no shape of their own
+            LogWarning("Logo scene cannot be drawn as shapes, using the generated shader");
+            logoRenderer = LogoRenderer::Generated;
         }
 
+        // Generated once, a repair reuses the source and StaticPass the
+        // pipeline built from it
+        if (!shaderManager->HasShader(generatedLogoShader))
         {
-            BufferDescriptor bufferDesc;
-            bufferDesc.size = 2 * 4;
-            bufferDesc.usage = BufferUsage::CopyDst | BufferUsage::Uniform;
-            bufferDesc.mappedAtCreation = false;
-            sporadicUniformBuffer = device.createBuffer(bufferDesc);
+            shaderManager->AddGenerated(generatedLogoShader, LogoScene().GenerateWgsl());
         }
+        logoPass.SetShader(device, shaderManager->GetShader(generatedLogoShader), surfaceFormat);
+    }
 
-        BindGroupEntry binding{};
+    // A fullscreen triangle sampling one texture. Inside the scene pass it
+    // needs a depth state, it leaves depth untouched. Blending draws a
+    // premultiplied source over what the target holds.
+    Handle<RenderPipeline> CreateBlitPipeline(bool sceneDepth, bool blend, const char *label)
+    {
+        ShaderModuleDescriptor shaderDesc;
 
-        binding.binding = 0;
-        // The buffer it is actually bound to
-        binding.buffer = frameUniformBuffer;
-        // We can specify an offset within the buffer, so that a single buffer can hold
-        // multiple uniform blocks.
-        binding.offset = 0;
-        // And we specify again the size of the buffer.
-        binding.size = sizeof(FrameUniforms);
+#ifdef WEBGPU_BACKEND_WGPU
+        shaderDesc.hintCount = 0;
+        shaderDesc.hints = nullptr;
+#endif
 
-        BindGroupDescriptor bindGroupDesc{};
-        bindGroupDesc.layout = frameBindGroupLayout;
-        // There must be as many bindings as declared in the layout!
-        bindGroupDesc.entryCount = 1;
-        bindGroupDesc.entries = &binding;
+        ShaderModuleWGSLDescriptor shaderCodeDesc{};
+        shaderCodeDesc.chain.next = nullptr;
+        shaderCodeDesc.chain.sType = SType::ShaderModuleWGSLDescriptor;
+        shaderDesc.nextInChain = &shaderCodeDesc.chain;
 
-        frameBindGroup = device.createBindGroup(bindGroupDesc);
+        const auto str = shaderManager->GetShader("blit.wgsl");
+        shaderCodeDesc.code = &str[0];
+        ShaderModule shaderModule = device.createShaderModule(shaderDesc);
 
-        binding.buffer = sporadicUniformBuffer;
-        binding.size = 4 * 2;
-        bindGroupDesc.layout = sporadicBindGroupLayout;
+        RenderPipelineDescriptor pipelineDesc;
 
-        sporadicBindGroup = device.createBindGroup(bindGroupDesc);
-    };
+        // A full screen triangle made up in the vertex shader
+        pipelineDesc.vertex.bufferCount = 0;
+        pipelineDesc.vertex.buffers = nullptr;
+        pipelineDesc.vertex.module = shaderModule;
+        pipelineDesc.vertex.entryPoint = "vs_main";
+        pipelineDesc.vertex.constantCount = 0;
+        pipelineDesc.vertex.constants = nullptr;
 
-    void OnMouseMove(double xpos, double ypos)
-    {
-        UpdateCameraDirection(static_cast<float>(xpos), static_cast<float>(ypos));
-    };
+        pipelineDesc.primitive.topology = PrimitiveTopology::TriangleList;
+        pipelineDesc.primitive.stripIndexFormat = IndexFormat::Undefined;
+        pipelineDesc.primitive.frontFace = FrontFace::CCW;
+        pipelineDesc.primitive.cullMode = CullMode::None;
 
-    void UpdateCameraDirection(float xpos, float ypos)
-    {
-        float s = 0.005f;
+        BlendState blendState;
+        blendState.color.srcFactor = BlendFactor::One;
+        blendState.color.dstFactor = BlendFactor::OneMinusSrcAlpha;
+        blendState.color.operation = BlendOperation::Add;
+        blendState.alpha = blendState.color;
+
+        ColorTargetState colorTarget;
+        colorTarget.format = surfaceFormat;
+        colorTarget.blend = blend ? &blendState : nullptr;
+        colorTarget.writeMask = ColorWriteMask::All;
 
-        float offsetX = (xpos - oldMouseX) * s;
-        float offsetY = (ypos - oldMouseY) * s;
+        FragmentState fragmentState;
+        fragmentState.module = shaderModule;
+        fragmentState.entryPoint = "fs_main";
+        fragmentState.constantCount = 0;
+        fragmentState.constants = nullptr;
+        fragmentState.targetCount = 1;
+        fragmentState.targets = &colorTarget;
+        pipelineDesc.fragment = &fragmentState;
 
-        oldMouseX = xpos;
-        oldMouseY = ypos;
+        DepthStencilState depthStencilState = Default;
+        depthStencilState.format = depthTextureFormat;
+        depthStencilState.depthCompare = CompareFunction::Always;
+        depthStencilState.depthWriteEnabled = false;
+        depthStencilState.stencilReadMask = 0;
+        depthStencilState.stencilWriteMask = 0;
+        pipelineDesc.depthStencil = sceneDepth ? &depthStencilState : nullptr;
 
-        cameraYaw += offsetX;
-        cameraPitch -= offsetY;
+        pipelineDesc.multisample.count = 1;
+        pipelineDesc.multisample.mask = ~0u;
+        pipelineDesc.multisample.alphaToCoverageEnabled = false;
 
-        cameraPitch = glm::clamp(cameraPitch, -glm::radians<float>(89), glm::radians<float>(89));
+        pipelineDesc.layout = resources.Get(blitLayout);
 
-        vec3 direction;
-        direction.x = sin(cameraYaw) * cos(cameraPitch);
-        direction.y = sin(cameraPitch);
-        direction.z = cos(cameraYaw) * cos(cameraPitch);
-        vec3 front = glm::normalize(direction);
-        vec3 right = glm::normalize(glm::cross(front, vec3(0.0, 1.0, 0.0))); // normalize the vectors, because their length gets closer to 0 the more you look up or down which results in slower movement.
-        vec3 up = glm::normalize(glm::cross(right, front));
-        viewMatrix = glm::lookAt(glm::vec3(0), front, up);
+        Handle<RenderPipeline> blitPipeline = resources.Add(device.createRenderPipeline(pipelineDesc), 0, label);
 
-        std::cout << cameraPitch << std::endl;
+        shaderModule.release();
+        return blitPipeline;
     };
 
-    RequiredLimits GetRequiredLimits(Adapter adapter) const
+    void InitializeBindGroupsAndBuffers()
     {
-        // Get adapter supported limits, in case we need them
-        SupportedLimits supportedLimits;
-        adapter.getLimits(&supportedLimits);
+        const Limits &limits = capabilities.GetLimits();
+        bufferPool.Initialize(device, queue, limits.maxBufferSize, limits.minUniformBufferOffsetAlignment);
+        stagingBelt.Initialize(device, capabilities.BufferChunkSize(StagingBelt::defaultChunkSize));
+        gpuTimer.Initialize(device, capabilities.HasFeature(WGPUFeatureName_TimestampQuery));
+        // Completion callbacks are only seen when polled, they would measure
+        // the frame interval with the vsync wait rather than GPU time
+        if (!gpuTimer.Available() && resolution.budget > 0.0)
+        {
+            LogWarning("No timestamp queries, dynamic resolution is unavailable");
+        }
 
-        // Don't forget to = Default
-        RequiredLimits requiredLimits = Default;
+        SamplerDescriptor samplerDesc = Default;
+        samplerDesc.addressModeU = AddressMode::ClampToEdge;
+        samplerDesc.addressModeV = AddressMode::ClampToEdge;
+        samplerDesc.addressModeW = AddressMode::ClampToEdge;
+        samplerDesc.magFilter = FilterMode::Linear;
+        samplerDesc.minFilter = FilterMode::Linear;
+        samplerDesc.mipmapFilter = MipmapFilterMode::Nearest;
+        samplerDesc.lodMinClamp = 0.0f;
+        samplerDesc.lodMaxClamp = 1.0f;
+        samplerDesc.compare = CompareFunction::Undefined;
+        samplerDesc.maxAnisotropy = 1;
+        blitSampler = resources.Add(device.createSampler(samplerDesc), 0, "Blit sampler");
+
+        mesh = meshStreamer.Request("resources/meshes/circle.obj");
+
+        frameSync.Initialize(framesInFlight);
+        sporadicUniformRange = bufferPool.Allocate(BufferClass::Uniform, 2 * 4);
+
+        // One uniform block per frame in flight, each with its bind group
+        for (uint32_t slot = 0; slot < frameSync.FramesInFlight(); ++slot)
+        {
+            frameUniformRanges[slot] = bufferPool.Allocate(BufferClass::Uniform, sizeof(FrameUniforms));
+        }
+        UpdateUniformBindGroups();
+    };
 
-        // We use at most 2 vertex attributes
-        requiredLimits.limits.maxVertexAttributes = 4;
-        // We should also tell that we use 1 vertex buffers
-        requiredLimits.limits.maxVertexBuffers = 1;
-        // Maximum size of a buffer is 15 vertices of 5 float each
-        requiredLimits.limits.maxBufferSize = 10000 * sizeof(Loader::VertexAttributes);
-        requiredLimits.limits.maxUniformBufferBindingSize = 144;
+    // The bind groups capture buffer and offset of their range, they are
+    // built again once defragmentation moved it
+    void UpdateUniformBindGroups()
+    {
+        for (uint32_t slot = 0; slot < frameSync.FramesInFlight(); ++slot)
+        {
+            UpdateUniformBindGroup(frameBindGroups[slot], frameBindGroupVersions[slot], frameBindGroupLayout, frameUniformRanges[slot], sizeof(FrameUniforms), "Frame bind group");
+        }
+        UpdateUniformBindGroup(sporadicBindGroup, sporadicBindGroupVersion, sporadicBindGroupLayout, sporadicUniformRange, 4 * 2, "Sporadic bind group");
+    }
+
+    void UpdateUniformBindGroup(Handle<BindGroup> &bindGroup, uint32_t &version, Handle<BindGroupLayout> bindGroupLayout, const BufferRange &range, uint64_t size, const char *label)
+    {
+        if (bindGroup && version == bufferPool.Version(range))
+        {
+            return;
+        }
+        // Frames still on the GPU may use the old one
+        resources.Release(bindGroup);
 
-        requiredLimits.limits.maxVertexBufferArrayStride = sizeof(Loader::VertexAttributes);
+        BindGroupEntry binding{};
+        binding.binding = 0;
+        // The buffer it is actually bound to
+        binding.buffer = bufferPool.GetBuffer(range);
+        // We can specify an offset within the buffer, so that a single buffer can hold
+        // multiple uniform blocks.
+        binding.offset = bufferPool.Offset(range);
+        // And we specify again the size of the buffer.
+        binding.size = size;
 
-        requiredLimits.limits.maxInterStageShaderComponents = 6;
-        requiredLimits.limits.maxBindGroups = 2;
-        requiredLimits.limits.maxUniformBuffersPerShaderStage = 2;
+        BindGroupDescriptor bindGroupDesc{};
+        bindGroupDesc.layout = resources.Get(bindGroupLayout);
+        // There must be as many bindings as declared in the layout!
+        bindGroupDesc.entryCount = 1;
+        bindGroupDesc.entries = &binding;
 
-        // These two limits are different because they are "minimum" limits,
-        // they are the only ones we are may forward from the adapter's supported
-        // limits.
-        requiredLimits.limits.minUniformBufferOffsetAlignment = supportedLimits.limits.minUniformBufferOffsetAlignment;
-        requiredLimits.limits.minStorageBufferOffsetAlignment = supportedLimits.limits.minStorageBufferOffsetAlignment;
-        return requiredLimits;
-    };
+        bindGroup = resources.Add(device.createBindGroup(bindGroupDesc), 0, label);
+        version = bufferPool.Version(range);
+    }
 
     Texture GetNextSurfaceTexture()
     {
@@ -751,26 +1251,63 @@ private:
     Surface surface;
     std::unique_ptr<ErrorCallback> uncapturedErrorCallbackHandle;
     TextureFormat surfaceFormat = TextureFormat::Undefined;
-    RenderPipeline pipeline;
+    Handle<RenderPipeline> pipeline;
     SurfaceConfiguration config;
-    Buffer frameUniformBuffer;
-    Buffer sporadicUniformBuffer;
-    Buffer vertexBuffer;
-    uint64_t vertexBufferSize;
-    PipelineLayout layout;
-    BindGroupLayout frameBindGroupLayout;
-    BindGroupLayout sporadicBindGroupLayout;
-    BindGroup frameBindGroup;
-    BindGroup sporadicBindGroup;
-    int vertexCount;
-    Texture depthTexture;
-    TextureView depthTextureView;
+    std::array<BufferRange, maxFramesInFlight> frameUniformRanges;
+    BufferRange sporadicUniformRange;
+    Handle<PipelineLayout> layout;
+    Handle<BindGroupLayout> frameBindGroupLayout;
+    Handle<BindGroupLayout> sporadicBindGroupLayout;
+    std::array<Handle<BindGroup>, maxFramesInFlight> frameBindGroups;
+    std::array<uint32_t, maxFramesInFlight> frameBindGroupVersions = {};
+    Handle<BindGroup> sporadicBindGroup;
+    uint32_t sporadicBindGroupVersion = 0;
+    MeshId mesh;
     TextureFormat depthTextureFormat = TextureFormat::Depth24Plus;
     mat4x4 projectionMatrix;
-    float oldMouseX = 0;
-    float oldMouseY = 0;
-    float cameraYaw = 0;
-    float cameraPitch = 0;
+    double lastCameraUpdate = 0.0;
+    // Time of the last input pump, everything simulated is driven by it so a
+    // replay reproduces the frames
+    double frameTime = 0.0;
+    InputRecorder inputRecorder;
+    InputReplay inputReplay;
     ShaderManager *shaderManager;
+    ReleaseQueue releaseQueue;
+    ResourceRegistry resources{releaseQueue};
+    BufferPool bufferPool{resources};
+    StagingBelt stagingBelt{bufferPool, releaseQueue};
+    // Scene color and depth for the last few scene sizes
+    RenderTargetCache renderTargets{resources, 8};
+    GpuTimer gpuTimer{resources};
+    RenderSize renderSize = {0, 0};
+    Handle<BindGroupLayout> blitBindGroupLayout;
+    Handle<PipelineLayout> blitLayout;
+    Handle<Sampler> blitSampler;
+    Handle<RenderPipeline> upscalePipeline;
+    Handle<BindGroup> upscaleBindGroup;
+    Handle<TextureView> upscaleSource;
+    // Name of the logo's generated WGSL in the shader manager
+    static constexpr const char *generatedLogoShader = "logo_scene.wgsl";
+    StaticPass logoPass{resources, "Logo"};
+    ShapeRenderer shapeRenderer{resources};
+    Handle<RenderPipeline> compositePipeline;
+    Handle<RenderPipeline> logoBlitPipeline;
+    Handle<BindGroup> logoBindGroup;
+    Handle<TextureView> logoSource;
+    FrameSync frameSync;
+    FramePacer framePacer;
+    std::vector<PresentMode> supportedPresentModes;
+    uint32_t frameSlot = 0;
+    DeviceCapabilities capabilities;
+    JobSystem jobs;
+    AssetReader assetReader;
+    MeshStreamer meshStreamer{jobs, assetReader, bufferPool, stagingBelt};
+    std::vector<DrawRange> drawRanges;
+    CullStats cullStats;
+    LatencyStats latency;
     bool crashed;
+    bool minimized = false;
+    bool resizePending = false;
+    int pendingWidth = 0;
+    int pendingHeight = 0;
 };
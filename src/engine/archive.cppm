@@ -0,0 +1,308 @@
+export module archive;
+
+import <algorithm>;
+import <cstddef>;
+import <cstdint>;
+import <cstring>;
+import <filesystem>;
+import <fstream>;
+import <span>;
+import <string>;
+import <string_view>;
+import <vector>;
+
+namespace fs = std::filesystem;
+
+// Layout of a packed asset archive (little endian):
+//
+//   ArchiveHeader                                  64 bytes
+//   ArchiveEntry[slotCount]                        open addressed hash table
+//   names                                          entry names, not terminated
+//   blobs                                          from dataOffset, page aligned
+//
+// Lookups hash the asset name and probe the table linearly, every slot is one
+// cache line. Blobs are sorted by name so a directory's assets share pages.
+
+export enum class Compression : uint32_t
+{
+    None,
+    LZ4,
+    Zstd
+};
+
+export constexpr uint32_t archiveMagic = 0x4B415053; // "SPAK"
+export constexpr uint32_t archiveVersion = 1;
+export constexpr uint64_t archiveDataAlignment = 4096;
+export constexpr uint64_t archiveBlobAlignment = 64;
+
+export struct ArchiveHeader
+{
+    uint32_t magic = archiveMagic;
+    uint32_t version = archiveVersion;
+    uint32_t slotCount = 0;
+    uint32_t entryCount = 0;
+    uint64_t tableOffset = 0;
+    uint64_t namesOffset = 0;
+    uint64_t namesSize = 0;
+    uint64_t dataOffset = 0;
+    uint64_t reserved[2] = {};
+};
+
+export struct ArchiveEntry
+{
+    // 0 marks an empty slot
+    uint64_t hash = 0;
+    uint64_t offset = 0;
+    uint64_t size = 0;
+    uint64_t rawSize = 0;
+    uint32_t nameOffset = 0;
+    uint32_t nameLength = 0;
+    Compression compression = Compression::None;
+    uint32_t flags = 0;
+    uint64_t reserved[2] = {};
+};
+
+static_assert(sizeof(ArchiveHeader) == 64);
+static_assert(sizeof(ArchiveEntry) == 64);
+
+// FNV-1a, usable at compile time for names known up front
+export constexpr uint64_t HashAssetName(std::string_view name)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (char c : name)
+    {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 0x100000001b3ull;
+    }
+    return hash == 0 ? 1 : hash;
+}
+
+// Read-only view over archive bytes, usually a memory mapping of the file.
+export class ArchiveView
+{
+public:
+    bool Parse(std::span<const std::byte> inBytes)
+    {
+        bytes = {};
+        table = {};
+
+        ArchiveHeader parsed;
+        if (inBytes.size() < sizeof(ArchiveHeader))
+        {
+            return false;
+        }
+        std::memcpy(&parsed, inBytes.data(), sizeof(ArchiveHeader));
+
+        const bool powerOfTwo = parsed.slotCount != 0 && (parsed.slotCount & (parsed.slotCount - 1)) == 0;
+        const uint64_t tableEnd = parsed.tableOffset + uint64_t(parsed.slotCount) * sizeof(ArchiveEntry);
+        if (parsed.magic != archiveMagic || parsed.version != archiveVersion || !powerOfTwo ||
+            parsed.tableOffset % alignof(ArchiveEntry) != 0 || tableEnd > inBytes.size() ||
+            parsed.namesOffset + parsed.namesSize > inBytes.size() || parsed.dataOffset > inBytes.size())
+        {
+            return false;
+        }
+
+        header = parsed;
+        bytes = inBytes;
+        table = {reinterpret_cast<const ArchiveEntry *>(inBytes.data() + header.tableOffset), header.slotCount};
+
+        for (const ArchiveEntry &entry : table)
+        {
+            if (entry.hash != 0 && (entry.offset + entry.size > bytes.size() || entry.nameOffset + uint64_t(entry.nameLength) > header.namesSize))
+            {
+                bytes = {};
+                table = {};
+                return false;
+            }
+        }
+        return true;
+    }
+
+    explicit operator bool() const
+    {
+        return !table.empty();
+    }
+
+    const ArchiveEntry *Find(std::string_view name) const
+    {
+        if (table.empty())
+        {
+            return nullptr;
+        }
+
+        const uint64_t hash = HashAssetName(name);
+        const uint32_t mask = header.slotCount - 1;
+        for (uint32_t probe = 0, slot = static_cast<uint32_t>(hash) & mask; probe < header.slotCount; ++probe, slot = (slot + 1) & mask)
+        {
+            const ArchiveEntry &entry = table[slot];
+            if (entry.hash == 0)
+            {
+                return nullptr;
+            }
+            if (entry.hash == hash && Name(entry) == name)
+            {
+                return &entry;
+            }
+        }
+        return nullptr;
+    }
+
+    std::string_view Name(const ArchiveEntry &entry) const
+    {
+        return {reinterpret_cast<const char *>(bytes.data() + header.namesOffset + entry.nameOffset), entry.nameLength};
+    }
+
+    // Stored bytes, still compressed if the entry is
+    std::span<const std::byte> Data(const ArchiveEntry &entry) const
+    {
+        return bytes.subspan(entry.offset, entry.size);
+    }
+
+    uint32_t Count() const
+    {
+        return header.entryCount;
+    }
+
+    // Calls fn(entry) for every entry whose name starts with prefix, in no
+    // particular order.
+    template <typename F>
+    void ForEach(std::string_view prefix, F &&fn) const
+    {
+        for (const ArchiveEntry &entry : table)
+        {
+            if (entry.hash != 0 && Name(entry).starts_with(prefix))
+            {
+                fn(entry);
+            }
+        }
+    }
+
+private:
+    ArchiveHeader header;
+    std::span<const std::byte> bytes;
+    std::span<const ArchiveEntry> table;
+};
+
+// Builds an archive file, used by the packing tool.
+export class ArchiveWriter
+{
+public:
+    // rawSize is the uncompressed size, defaults to the stored size.
+    void Add(std::string name, std::vector<std::byte> data, Compression compression = Compression::None, uint64_t rawSize = 0)
+    {
+        const uint64_t size = data.size();
+        blobs.push_back({std::move(name), std::move(data), compression, rawSize != 0 ? rawSize : size});
+    }
+
+    bool Write(const fs::path &path)
+    {
+        std::sort(blobs.begin(), blobs.end(), [](const Blob &a, const Blob &b)
+                  { return a.name < b.name; });
+        for (size_t i = 1; i < blobs.size(); ++i)
+        {
+            if (blobs[i].name == blobs[i - 1].name)
+            {
+                return false;
+            }
+        }
+
+        // At most half full keeps probe sequences short
+        uint32_t slotCount = 8;
+        while (slotCount < blobs.size() * 2)
+        {
+            slotCount *= 2;
+        }
+
+        ArchiveHeader header;
+        header.slotCount = slotCount;
+        header.entryCount = static_cast<uint32_t>(blobs.size());
+        header.tableOffset = sizeof(ArchiveHeader);
+        header.namesOffset = header.tableOffset + uint64_t(slotCount) * sizeof(ArchiveEntry);
+
+        std::string names;
+        std::vector<ArchiveEntry> table(slotCount);
+        std::vector<uint32_t> slots;
+        for (const Blob &blob : blobs)
+        {
+            ArchiveEntry entry;
+            entry.hash = HashAssetName(blob.name);
+            entry.size = blob.data.size();
+            entry.rawSize = blob.rawSize;
+            entry.nameOffset = static_cast<uint32_t>(names.size());
+            entry.nameLength = static_cast<uint32_t>(blob.name.size());
+            entry.compression = blob.compression;
+            names += blob.name;
+
+            uint32_t slot = static_cast<uint32_t>(entry.hash) & (slotCount - 1);
+            while (table[slot].hash != 0)
+            {
+                slot = (slot + 1) & (slotCount - 1);
+            }
+            table[slot] = entry;
+            slots.push_back(slot);
+        }
+        header.namesSize = names.size();
+        header.dataOffset = Align(header.namesOffset + header.namesSize, archiveDataAlignment);
+
+        // Blob offsets follow the sorted order
+        uint64_t offset = header.dataOffset;
+        for (size_t i = 0; i < blobs.size(); ++i)
+        {
+            table[slots[i]].offset = offset;
+            offset = Align(offset + blobs[i].data.size(), archiveBlobAlignment);
+        }
+
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if (!file)
+        {
+            return false;
+        }
+
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char *>(table.data()), table.size() * sizeof(ArchiveEntry));
+        file.write(names.data(), names.size());
+
+        uint64_t written = header.namesOffset + header.namesSize;
+        for (size_t i = 0; i < blobs.size(); ++i)
+        {
+            const ArchiveEntry &entry = table[slots[i]];
+            Pad(file, entry.offset - written);
+            file.write(reinterpret_cast<const char *>(blobs[i].data.data()), blobs[i].data.size());
+            written = entry.offset + blobs[i].data.size();
+        }
+
+        return static_cast<bool>(file);
+    }
+
+    size_t Count() const
+    {
+        return blobs.size();
+    }
+
+private:
+    struct Blob
+    {
+        std::string name;
+        std::vector<std::byte> data;
+        Compression compression;
+        uint64_t rawSize;
+    };
+
+    static uint64_t Align(uint64_t value, uint64_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    static void Pad(std::ofstream &file, uint64_t count)
+    {
+        static const char zeros[archiveBlobAlignment] = {};
+        while (count > 0)
+        {
+            const uint64_t step = std::min<uint64_t>(count, sizeof(zeros));
+            file.write(zeros, step);
+            count -= step;
+        }
+    }
+
+    std::vector<Blob> blobs;
+};
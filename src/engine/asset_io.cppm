@@ -0,0 +1,518 @@
+module;
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#elif !defined(__EMSCRIPTEN__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef SHADY_WITH_IO_URING
+#include <liburing.h>
+#endif
+
+export module asset_io;
+
+import <algorithm>;
+import <cstddef>;
+import <cstdint>;
+import <filesystem>;
+import <fstream>;
+import <memory>;
+import <mutex>;
+import <span>;
+import <streambuf>;
+import <string>;
+import <string_view>;
+import <unordered_map>;
+import <utility>;
+import <vector>;
+
+import archive;
+
+namespace fs = std::filesystem;
+
+// Read-only view of a whole file, memory mapped where the platform allows it so
+// parsers can work on the page cache directly instead of a private copy.
+export class MappedFile
+{
+public:
+    MappedFile() {};
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    MappedFile(MappedFile &&other) noexcept
+    {
+        *this = std::move(other);
+    }
+
+    MappedFile &operator=(MappedFile &&other) noexcept
+    {
+        if (this != &other)
+        {
+            Close();
+            data = std::exchange(other.data, nullptr);
+            size = std::exchange(other.size, 0);
+            fallback = std::move(other.fallback);
+#ifdef _WIN32
+            mapping = std::exchange(other.mapping, nullptr);
+#endif
+        }
+        return *this;
+    }
+
+    ~MappedFile()
+    {
+        Close();
+    }
+
+    bool Open(const fs::path &path)
+    {
+        Close();
+
+#if defined(_WIN32)
+        HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize))
+        {
+            CloseHandle(file);
+            return false;
+        }
+        size = static_cast<size_t>(fileSize.QuadPart);
+
+        if (size > 0)
+        {
+            mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping)
+            {
+                data = static_cast<const std::byte *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+            }
+        }
+        CloseHandle(file);
+
+        if (size > 0 && !data)
+        {
+            Close();
+            return false;
+        }
+        return true;
+#elif !defined(__EMSCRIPTEN__)
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return false;
+        }
+
+        struct stat info;
+        if (fstat(fd, &info) != 0)
+        {
+            close(fd);
+            return false;
+        }
+        size = static_cast<size_t>(info.st_size);
+
+        if (size > 0)
+        {
+            void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped == MAP_FAILED)
+            {
+                close(fd);
+                size = 0;
+                return false;
+            }
+            data = static_cast<const std::byte *>(mapped);
+        }
+        close(fd);
+        return true;
+#else
+        // No mmap on the web, the virtual file system lives in memory anyway
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file)
+        {
+            return false;
+        }
+        fallback.resize(static_cast<size_t>(file.tellg()));
+        file.seekg(0);
+        file.read(reinterpret_cast<char *>(fallback.data()), fallback.size());
+        data = fallback.data();
+        size = fallback.size();
+        return true;
+#endif
+    }
+
+    void Close()
+    {
+#if defined(_WIN32)
+        if (data)
+        {
+            UnmapViewOfFile(data);
+        }
+        if (mapping)
+        {
+            CloseHandle(mapping);
+            mapping = nullptr;
+        }
+#elif !defined(__EMSCRIPTEN__)
+        if (data)
+        {
+            munmap(const_cast<std::byte *>(data), size);
+        }
+#endif
+        fallback.clear();
+        data = nullptr;
+        size = 0;
+    }
+
+    // Asks the kernel to start reading the pages in before they are touched.
+    // The range defaults to the whole file.
+    void WillNeed(std::span<const std::byte> range = {}) const
+    {
+        range = Clamp(range);
+        if (range.empty())
+        {
+            return;
+        }
+#if defined(_WIN32)
+        WIN32_MEMORY_RANGE_ENTRY entry{const_cast<std::byte *>(range.data()), range.size()};
+        PrefetchVirtualMemory(GetCurrentProcess(), 1, &entry, 0);
+#elif !defined(__EMSCRIPTEN__)
+        Advise(range, MADV_WILLNEED);
+#endif
+    }
+
+    // Hints a front to back scan so the kernel reads ahead aggressively.
+    void Sequential(std::span<const std::byte> range = {}) const
+    {
+#if !defined(_WIN32) && !defined(__EMSCRIPTEN__)
+        range = Clamp(range);
+        if (!range.empty())
+        {
+            Advise(range, MADV_SEQUENTIAL);
+        }
+#else
+        (void)range;
+#endif
+    }
+
+    std::span<const std::byte> Bytes() const
+    {
+        return {data, size};
+    }
+
+    std::string_view Text() const
+    {
+        return {reinterpret_cast<const char *>(data), size};
+    }
+
+private:
+    std::span<const std::byte> Clamp(std::span<const std::byte> range) const
+    {
+        if (range.empty())
+        {
+            return Bytes();
+        }
+        // Only ranges inside this mapping make sense
+        if (range.data() < data || range.data() + range.size() > data + size)
+        {
+            return {};
+        }
+        return range;
+    }
+
+#if !defined(_WIN32) && !defined(__EMSCRIPTEN__)
+    static void Advise(std::span<const std::byte> range, int advice)
+    {
+        // madvise wants page aligned addresses
+        static const uintptr_t pageSize = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+        const uintptr_t begin = reinterpret_cast<uintptr_t>(range.data()) & ~(pageSize - 1);
+        const uintptr_t end = reinterpret_cast<uintptr_t>(range.data() + range.size());
+        madvise(reinterpret_cast<void *>(begin), end - begin, advice);
+    }
+#endif
+
+    const std::byte *data = nullptr;
+    size_t size = 0;
+    std::vector<std::byte> fallback;
+#ifdef _WIN32
+    HANDLE mapping = nullptr;
+#endif
+};
+
+// Lets std::istream based parsers (tinyobjloader) read a byte span in place.
+export class SpanStreamBuf : public std::streambuf
+{
+public:
+    SpanStreamBuf(std::span<const std::byte> bytes)
+    {
+        char *begin = const_cast<char *>(reinterpret_cast<const char *>(bytes.data()));
+        setg(begin, begin, begin + bytes.size());
+    }
+};
+
+// Bytes of one asset and the mapping keeping them alive. Assets served from
+// the mounted archive share the archive's mapping.
+export struct AssetView
+{
+    std::shared_ptr<const MappedFile> file;
+    std::span<const std::byte> bytes;
+
+    explicit operator bool() const
+    {
+        return file != nullptr;
+    }
+
+    std::string_view Text() const
+    {
+        return {reinterpret_cast<const char *>(bytes.data()), bytes.size()};
+    }
+
+    void WillNeed() const
+    {
+        if (file && !bytes.empty())
+        {
+            file->WillNeed(bytes);
+        }
+    }
+
+    void Sequential() const
+    {
+        if (file && !bytes.empty())
+        {
+            file->Sequential(bytes);
+        }
+    }
+};
+
+// Resolves asset paths to bytes. Paths under the mount point are served from
+// the packed archive when one is mounted, anything else (or anything missing
+// from the archive) from loose files. Loose files stay mapped between the
+// moment they are queued and the moment a parser asks for them, so the kernel
+// can prefetch in between. Thread safe once mounted.
+export class AssetReader
+{
+public:
+    // Maps the archive once, call before any asset is requested.
+    bool Mount(const fs::path &archivePath, const fs::path &inMountPoint = "resources")
+    {
+        auto file = std::make_shared<MappedFile>();
+        if (!file->Open(archivePath) || !archive.Parse(file->Bytes()))
+        {
+            return false;
+        }
+        archiveFile = std::move(file);
+        mountPoint = inMountPoint.lexically_normal();
+        return true;
+    }
+
+    bool Mounted() const
+    {
+        return static_cast<bool>(archive);
+    }
+
+    // Maps the asset and starts reading it in the background.
+    AssetView Queue(const fs::path &path)
+    {
+        AssetView view = Open(path);
+        view.WillNeed();
+        return view;
+    }
+
+    AssetView Open(const fs::path &path)
+    {
+        if (AssetView packed = OpenPacked(path))
+        {
+            return packed;
+        }
+
+        const std::string key = path.lexically_normal().string();
+        {
+            std::lock_guard lock(mutex);
+            if (auto it = files.find(key); it != files.end())
+            {
+                return {it->second, it->second->Bytes()};
+            }
+        }
+
+        auto file = std::make_shared<MappedFile>();
+        if (!file->Open(path))
+        {
+            return {};
+        }
+
+        std::lock_guard lock(mutex);
+        const auto &cached = files.try_emplace(key, std::move(file)).first->second;
+        return {cached, cached->Bytes()};
+    }
+
+    // Drops the cached mapping, views handed out stay valid while referenced.
+    void Release(const fs::path &path)
+    {
+        std::lock_guard lock(mutex);
+        files.erase(path.lexically_normal().string());
+    }
+
+    // Calls fn(path, view) for every uncompressed archived asset under the
+    // directory, paths include the mount point.
+    template <typename F>
+    void ForEachPacked(const fs::path &directory, F &&fn) const
+    {
+        const std::string prefix = ArchiveName(directory / "");
+        if (!archive || prefix.empty())
+        {
+            return;
+        }
+        archive.ForEach(prefix, [&](const ArchiveEntry &entry)
+                        {
+            if (entry.compression == Compression::None)
+            {
+                fn(mountPoint / archive.Name(entry), AssetView{archiveFile, archive.Data(entry)});
+            } });
+    }
+
+    // Reads many small files at once. With io_uring all reads are in flight
+    // together instead of one open/read round trip after another. Files that
+    // could not be read are left empty; returns false if any failed.
+    static bool ReadBatch(std::span<const fs::path> paths, std::vector<std::string> &contents)
+    {
+        contents.assign(paths.size(), {});
+
+#ifdef SHADY_WITH_IO_URING
+        constexpr unsigned queueDepth = 64;
+
+        io_uring ring;
+        if (io_uring_queue_init(queueDepth, &ring, 0) == 0)
+        {
+            bool ok = true;
+            for (size_t first = 0; first < paths.size(); first += queueDepth)
+            {
+                const size_t last = std::min(first + queueDepth, paths.size());
+                std::vector<int> fds(last - first, -1);
+                unsigned submitted = 0;
+
+                for (size_t i = first; i < last; ++i)
+                {
+                    int fd = open(paths[i].c_str(), O_RDONLY);
+                    struct stat info;
+                    if (fd < 0 || fstat(fd, &info) != 0)
+                    {
+                        if (fd >= 0)
+                        {
+                            close(fd);
+                        }
+                        ok = false;
+                        continue;
+                    }
+                    fds[i - first] = fd;
+                    contents[i].resize(static_cast<size_t>(info.st_size));
+                    if (contents[i].empty())
+                    {
+                        continue;
+                    }
+
+                    io_uring_sqe *sqe = io_uring_get_sqe(&ring);
+                    io_uring_prep_read(sqe, fd, contents[i].data(), static_cast<unsigned>(contents[i].size()), 0);
+                    io_uring_sqe_set_data(sqe, reinterpret_cast<void *>(static_cast<uintptr_t>(i)));
+                    submitted++;
+                }
+
+                io_uring_submit(&ring);
+
+                for (unsigned done = 0; done < submitted; ++done)
+                {
+                    io_uring_cqe *cqe;
+                    if (io_uring_wait_cqe(&ring, &cqe) != 0)
+                    {
+                        ok = false;
+                        break;
+                    }
+                    const size_t i = static_cast<size_t>(reinterpret_cast<uintptr_t>(io_uring_cqe_get_data(cqe)));
+                    const int result = cqe->res;
+                    io_uring_cqe_seen(&ring, cqe);
+
+                    // Short reads are finished synchronously
+                    size_t read = result > 0 ? static_cast<size_t>(result) : 0;
+                    while (result >= 0 && read < contents[i].size())
+                    {
+                        const ssize_t more = pread(fds[i - first], contents[i].data() + read, contents[i].size() - read, static_cast<off_t>(read));
+                        if (more <= 0)
+                        {
+                            break;
+                        }
+                        read += static_cast<size_t>(more);
+                    }
+                    if (read != contents[i].size())
+                    {
+                        contents[i].clear();
+                        ok = false;
+                    }
+                }
+
+                for (int fd : fds)
+                {
+                    if (fd >= 0)
+                    {
+                        close(fd);
+                    }
+                }
+            }
+            io_uring_queue_exit(&ring);
+            return ok;
+        }
+#endif
+
+        bool ok = true;
+        for (size_t i = 0; i < paths.size(); ++i)
+        {
+            MappedFile file;
+            if (!file.Open(paths[i]))
+            {
+                ok = false;
+                continue;
+            }
+            contents[i] = file.Text();
+        }
+        return ok;
+    }
+
+private:
+    // Name of a path inside the archive, empty if it is not under the mount point
+    std::string ArchiveName(const fs::path &path) const
+    {
+        const fs::path relative = path.lexically_normal().lexically_relative(mountPoint);
+        if (relative.empty() || *relative.begin() == "..")
+        {
+            return {};
+        }
+        return relative.generic_string();
+    }
+
+    AssetView OpenPacked(const fs::path &path) const
+    {
+        if (!archive)
+        {
+            return {};
+        }
+        const ArchiveEntry *entry = archive.Find(ArchiveName(path));
+        if (!entry || entry->compression != Compression::None)
+        {
+            return {};
+        }
+        return {archiveFile, archive.Data(*entry)};
+    }
+
+    std::shared_ptr<const MappedFile> archiveFile;
+    ArchiveView archive;
+    fs::path mountPoint;
+    std::mutex mutex;
+    std::unordered_map<std::string, std::shared_ptr<MappedFile>> files;
+};
@@ -0,0 +1,236 @@
+export module attributes;
+
+import <cmath>;
+import <cstdint>;
+import <cstring>;
+import <span>;
+import <unordered_map>;
+import <vector>;
+
+import jobs;
+import loader;
+
+constexpr size_t attributeGrain = 4096;
+
+// Corners (triangle * 3 + k) touching each group of vertices, compressed rows
+struct CornerTable
+{
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> corners;
+};
+
+CornerTable BuildCornerTable(std::span<const uint32_t> indices, std::span<const uint32_t> groups, uint32_t groupCount)
+{
+    CornerTable table;
+    table.offsets.assign(groupCount + 1, 0);
+    for (uint32_t index : indices)
+    {
+        table.offsets[groups[index] + 1]++;
+    }
+    for (uint32_t g = 0; g < groupCount; ++g)
+    {
+        table.offsets[g + 1] += table.offsets[g];
+    }
+
+    table.corners.resize(indices.size());
+    std::vector<uint32_t> fill(table.offsets.begin(), table.offsets.end() - 1);
+    for (uint32_t i = 0; i < indices.size(); ++i)
+    {
+        table.corners[fill[groups[indices[i]]]++] = i;
+    }
+    return table;
+}
+
+// Vertices split along uv or material seams still share their position, the
+// normals have to be smoothed across them or the seams show.
+std::vector<uint32_t> WeldPositions(std::span<const Loader::VertexAttributes> vertices, uint32_t &groupCount)
+{
+    struct PositionHash
+    {
+        size_t operator()(const vec3 &p) const
+        {
+            uint32_t bits[3];
+            // -0 and 0 are the same place
+            const float values[3] = {p.x + 0.0f, p.y + 0.0f, p.z + 0.0f};
+            std::memcpy(bits, values, sizeof(bits));
+            return (size_t(bits[0]) * 73856093) ^ (size_t(bits[1]) * 19349663) ^ (size_t(bits[2]) * 83492791);
+        }
+    };
+
+    std::unordered_map<vec3, uint32_t, PositionHash> positions;
+    positions.reserve(vertices.size());
+
+    std::vector<uint32_t> groups(vertices.size());
+    for (size_t v = 0; v < vertices.size(); ++v)
+    {
+        groups[v] = positions.try_emplace(vertices[v].position, static_cast<uint32_t>(positions.size())).first->second;
+    }
+    groupCount = static_cast<uint32_t>(positions.size());
+    return groups;
+}
+
+// Angle of the triangle at corner k, 0 for degenerate edges
+float CornerAngle(const vec3 (&p)[3], int k)
+{
+    const vec3 a = p[(k + 1) % 3] - p[k];
+    const vec3 b = p[(k + 2) % 3] - p[k];
+    const float lengths = glm::length(a) * glm::length(b);
+    if (lengths <= 0.0f)
+    {
+        return 0.0f;
+    }
+    return std::acos(glm::clamp(glm::dot(a, b) / lengths, -1.0f, 1.0f));
+}
+
+// Any unit vector perpendicular to n
+vec3 Perpendicular(vec3 n)
+{
+    const vec3 axis = std::abs(n.x) < 0.9f ? vec3(1.0f, 0.0f, 0.0f) : vec3(0.0f, 1.0f, 0.0f);
+    return glm::normalize(glm::cross(n, axis));
+}
+
+// Smooth normals weighted by triangle area and corner angle, so neither long
+// thin triangles nor dense tessellation pull them around. Overwrites any
+// normals the mesh has.
+export void GenerateNormals(Loader::Mesh &mesh, JobSystem &jobs)
+{
+    const std::vector<uint32_t> &indices = mesh.indices;
+    std::vector<Loader::VertexAttributes> &vertices = mesh.vertices;
+    const size_t triangleCount = indices.size() / 3;
+
+    std::vector<vec3> cornerNormals(triangleCount * 3);
+    jobs.ParallelFor(triangleCount, attributeGrain, [&](size_t begin, size_t end)
+                     {
+        for (size_t t = begin; t < end; ++t)
+        {
+            const vec3 p[3] = {vertices[indices[t * 3]].position, vertices[indices[t * 3 + 1]].position, vertices[indices[t * 3 + 2]].position};
+            // Twice the area long
+            const vec3 normal = glm::cross(p[1] - p[0], p[2] - p[0]);
+            for (int k = 0; k < 3; ++k)
+            {
+                cornerNormals[t * 3 + k] = normal * CornerAngle(p, k);
+            }
+        } });
+
+    uint32_t groupCount = 0;
+    const std::vector<uint32_t> groups = WeldPositions(vertices, groupCount);
+    const CornerTable table = BuildCornerTable(std::span(indices).first(triangleCount * 3), groups, groupCount);
+
+    std::vector<vec3> groupNormals(groupCount);
+    jobs.ParallelFor(groupCount, attributeGrain, [&](size_t begin, size_t end)
+                     {
+        for (size_t g = begin; g < end; ++g)
+        {
+            vec3 sum(0.0f);
+            for (uint32_t c = table.offsets[g]; c < table.offsets[g + 1]; ++c)
+            {
+                sum += cornerNormals[table.corners[c]];
+            }
+            const float length = glm::length(sum);
+            groupNormals[g] = length > 0.0f ? sum / length : vec3(0.0f, 0.0f, 1.0f);
+        } });
+
+    jobs.ParallelFor(vertices.size(), attributeGrain, [&](size_t begin, size_t end)
+                     {
+        for (size_t v = begin; v < end; ++v)
+        {
+            vertices[v].normal = groupNormals[groups[v]];
+        } });
+
+    mesh.streams |= Loader::StreamNormal;
+}
+
+// Per-vertex tangent frames following MikkTSpace's conventions: the texture
+// space derivatives of every corner are weighted by the corner angle, the sum
+// is Gram-Schmidt orthogonalized against the vertex normal and w holds the
+// handedness, so normal maps baked with MikkTSpace tools shade the same.
+// Needs normals and texture coordinates. Vertices are already split at uv
+// seams by the loader, mirrored halves sharing a vertex are not split again.
+export void GenerateTangents(Loader::Mesh &mesh, JobSystem &jobs)
+{
+    const std::vector<uint32_t> &indices = mesh.indices;
+    std::vector<Loader::VertexAttributes> &vertices = mesh.vertices;
+    const size_t triangleCount = indices.size() / 3;
+
+    std::vector<vec3> cornerTangents(triangleCount * 3);
+    std::vector<vec3> cornerBitangents(triangleCount * 3);
+    jobs.ParallelFor(triangleCount, attributeGrain, [&](size_t begin, size_t end)
+                     {
+        for (size_t t = begin; t < end; ++t)
+        {
+            const Loader::VertexAttributes *corner[3] = {&vertices[indices[t * 3]], &vertices[indices[t * 3 + 1]], &vertices[indices[t * 3 + 2]]};
+            const vec3 p[3] = {corner[0]->position, corner[1]->position, corner[2]->position};
+
+            const vec3 e1 = p[1] - p[0];
+            const vec3 e2 = p[2] - p[0];
+            const vec2 d1 = corner[1]->uv - corner[0]->uv;
+            const vec2 d2 = corner[2]->uv - corner[0]->uv;
+            const float det = d1.x * d2.y - d2.x * d1.y;
+
+            // Only the direction matters, the sign of det keeps the orientation
+            vec3 tangent(0.0f);
+            vec3 bitangent(0.0f);
+            if (std::abs(det) > 1e-12f)
+            {
+                const float orientation = det > 0.0f ? 1.0f : -1.0f;
+                tangent = (e1 * d2.y - e2 * d1.y) * orientation;
+                bitangent = (e2 * d1.x - e1 * d2.x) * orientation;
+            }
+
+            for (int k = 0; k < 3; ++k)
+            {
+                const vec3 &n = corner[k]->normal;
+                vec3 projected = tangent - n * glm::dot(n, tangent);
+                vec3 projectedBitangent = bitangent - n * glm::dot(n, bitangent);
+                const float tangentLength = glm::length(projected);
+                const float bitangentLength = glm::length(projectedBitangent);
+                const float angle = CornerAngle(p, k);
+                cornerTangents[t * 3 + k] = tangentLength > 0.0f ? projected * (angle / tangentLength) : vec3(0.0f);
+                cornerBitangents[t * 3 + k] = bitangentLength > 0.0f ? projectedBitangent * (angle / bitangentLength) : vec3(0.0f);
+            }
+        } });
+
+    std::vector<uint32_t> identity(vertices.size());
+    for (uint32_t v = 0; v < identity.size(); ++v)
+    {
+        identity[v] = v;
+    }
+    const CornerTable table = BuildCornerTable(std::span(indices).first(triangleCount * 3), identity, static_cast<uint32_t>(vertices.size()));
+
+    jobs.ParallelFor(vertices.size(), attributeGrain, [&](size_t begin, size_t end)
+                     {
+        for (size_t v = begin; v < end; ++v)
+        {
+            vec3 tangent(0.0f);
+            vec3 bitangent(0.0f);
+            for (uint32_t c = table.offsets[v]; c < table.offsets[v + 1]; ++c)
+            {
+                tangent += cornerTangents[table.corners[c]];
+                bitangent += cornerBitangents[table.corners[c]];
+            }
+
+            const vec3 &n = vertices[v].normal;
+            tangent -= n * glm::dot(n, tangent);
+            const float length = glm::length(tangent);
+            tangent = length > 1e-12f ? tangent / length : Perpendicular(n);
+            const float handedness = glm::dot(glm::cross(n, tangent), bitangent) < 0.0f ? -1.0f : 1.0f;
+            vertices[v].tangent = vec4(tangent, handedness);
+        } });
+
+    mesh.streams |= Loader::StreamTangent;
+}
+
+// Fills in what the source did not have: smooth normals, then tangents for
+// meshes with texture coordinates. Without uvs there is no tangent space and
+// the stream stays absent.
+export void GenerateAttributes(Loader::Mesh &mesh, JobSystem &jobs)
+{
+    if (!(mesh.streams & Loader::StreamNormal))
+    {
+        GenerateNormals(mesh, jobs);
+    }
+    if ((mesh.streams & Loader::StreamUv) && !(mesh.streams & Loader::StreamTangent))
+    {
+        GenerateTangents(mesh, jobs);
+    }
+}
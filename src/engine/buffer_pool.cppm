@@ -0,0 +1,344 @@
+module;
+
+#include <webgpu/webgpu.hpp>
+
+export module buffer_pool;
+
+import <algorithm>;
+import <cstdint>;
+import <iostream>;
+import <vector>;
+
+import allocator;
+import logging;
+import resources;
+
+using namespace wgpu;
+
+export enum class BufferClass : uint32_t
+{
+    Vertex,
+    Index,
+    Uniform,
+    Count
+};
+
+// A range suballocated from one of the pool's pages. Offset and buffer must be
+// looked up through the pool since defragmentation may move the range.
+export struct BufferRange
+{
+    BufferClass usage = BufferClass::Vertex;
+    uint32_t page = TlsfAllocator::invalid;
+    uint32_t block = TlsfAllocator::invalid;
+    uint64_t size = 0;
+
+    explicit operator bool() const
+    {
+        return block != TlsfAllocator::invalid;
+    }
+};
+
+export struct BufferClassStats
+{
+    const char *name;
+    uint32_t pages;
+    uint32_t allocations;
+    uint64_t capacity;
+    uint64_t used;
+    uint64_t largestFree;
+    float fragmentation;
+};
+
+// Keeps a few large buffers per usage class and hands out offset ranges in them
+// so meshes and uniform blocks do not each need their own buffer object.
+export class BufferPool
+{
+public:
+    static constexpr uint64_t defaultPageSizes[] = {16ull << 20, 8ull << 20, 64ull << 10};
+
+    BufferPool(ResourceRegistry &inResources) : resources(inResources) {};
+
+    BufferPool(const BufferPool &) = delete;
+    BufferPool &operator=(const BufferPool &) = delete;
+
+    void Initialize(Device inDevice, Queue inQueue, uint64_t inMaxBufferSize, uint32_t uniformAlignment)
+    {
+        device = inDevice;
+        queue = inQueue;
+        maxBufferSize = inMaxBufferSize;
+
+        // Copies and vertex/index offsets need 4 byte alignment, uniform bindings
+        // need the device's offset alignment
+        classes[static_cast<uint32_t>(BufferClass::Vertex)].granularity = 16;
+        classes[static_cast<uint32_t>(BufferClass::Index)].granularity = 16;
+        classes[static_cast<uint32_t>(BufferClass::Uniform)].granularity = std::max<uint32_t>(uniformAlignment, 16);
+
+        for (uint32_t i = 0; i < static_cast<uint32_t>(BufferClass::Count); ++i)
+        {
+            classes[i].pageSize = std::min(defaultPageSizes[i], maxBufferSize);
+        }
+    }
+
+    BufferRange Allocate(BufferClass usage, uint64_t size)
+    {
+        Class &bufferClass = classes[static_cast<uint32_t>(usage)];
+
+        for (uint32_t pageIndex = 0; pageIndex < bufferClass.pages.size(); ++pageIndex)
+        {
+            Page &page = bufferClass.pages[pageIndex];
+            if (!page.buffer)
+            {
+                continue;
+            }
+
+            if (auto allocation = page.allocator.Allocate(size))
+            {
+                return {usage, pageIndex, allocation.block, size};
+            }
+        }
+
+        // Oversized requests get a page of their own, released once it empties
+        const uint64_t granularity = bufferClass.granularity;
+        const bool dedicated = size > bufferClass.pageSize;
+        const uint64_t capacity = dedicated ? (size + granularity - 1) / granularity * granularity : bufferClass.pageSize;
+        if (capacity > maxBufferSize)
+        {
+            LogError("Buffer pool: {} bytes exceed the device buffer size limit", size);
+            return {};
+        }
+
+        const uint32_t pageIndex = CreatePage(usage, capacity, dedicated);
+        auto allocation = bufferClass.pages[pageIndex].allocator.Allocate(size);
+        return {usage, pageIndex, allocation.block, size};
+    }
+
+    void Free(BufferRange &range)
+    {
+        if (!range)
+        {
+            return;
+        }
+
+        Page &page = PageOf(range);
+        page.allocator.Free(range.block);
+
+        if (page.dedicated && page.allocator.GetStats().allocations == 0)
+        {
+            resources.Release(page.buffer);
+        }
+
+        range = {};
+    }
+
+    Buffer GetBuffer(const BufferRange &range)
+    {
+        return resources.Get(PageOf(range).buffer);
+    }
+
+    uint64_t Offset(const BufferRange &range)
+    {
+        return PageOf(range).allocator.Offset(range.block);
+    }
+
+    // Changes whenever the page's buffer was replaced, so bind groups built
+    // against the old one can be recreated.
+    uint32_t Version(const BufferRange &range)
+    {
+        return PageOf(range).version;
+    }
+
+    void Write(const BufferRange &range, const void *data, uint64_t size, uint64_t offset = 0)
+    {
+        queue.writeBuffer(GetBuffer(range), Offset(range) + offset, data, size);
+    }
+
+    // Compacts pages whose free space is scattered above the threshold into a
+    // fresh buffer. The copies go in a submit of their own, so call this at the
+    // start of a frame before anything is written: a queue write lands before
+    // any command buffer submitted after it, the copies would overwrite it.
+    // Ranges stay valid, Version tells when their buffer and offset changed.
+    // The old buffer is retired once the frames using it have completed.
+    bool Defragment(float threshold = 0.25f)
+    {
+        CommandEncoder encoder = nullptr;
+
+        for (uint32_t classIndex = 0; classIndex < static_cast<uint32_t>(BufferClass::Count); ++classIndex)
+        {
+            Class &bufferClass = classes[classIndex];
+            for (Page &page : bufferClass.pages)
+            {
+                if (!page.buffer || page.allocator.GetStats().Fragmentation() <= threshold)
+                {
+                    continue;
+                }
+
+                const auto moves = page.allocator.Defragment();
+                if (moves.empty())
+                {
+                    continue;
+                }
+
+                if (!encoder)
+                {
+                    CommandEncoderDescriptor encoderDesc = {};
+                    encoderDesc.label = "Buffer pool defragmentation";
+                    encoder = device.createCommandEncoder(encoderDesc);
+                }
+
+                Handle<Buffer> compacted = CreateBuffer(static_cast<BufferClass>(classIndex), page.allocator.Capacity());
+                Buffer source = resources.Get(page.buffer);
+                Buffer destination = resources.Get(compacted);
+
+                // Everything before the first move already sits at its final offset
+                if (moves.front().destinationOffset > 0)
+                {
+                    encoder.copyBufferToBuffer(source, 0, destination, 0, moves.front().destinationOffset);
+                }
+                for (const auto &move : moves)
+                {
+                    encoder.copyBufferToBuffer(source, move.sourceOffset, destination, move.destinationOffset, move.size);
+                }
+
+                resources.Release(page.buffer);
+                page.buffer = compacted;
+                page.version++;
+                defragmentations++;
+            }
+        }
+
+        if (!encoder)
+        {
+            return false;
+        }
+
+        CommandBufferDescriptor cmdBufferDescriptor = {};
+        cmdBufferDescriptor.label = "Buffer pool defragmentation";
+        CommandBuffer command = encoder.finish(cmdBufferDescriptor);
+        encoder.release();
+        queue.submit(1, &command);
+        command.release();
+        return true;
+    }
+
+    std::vector<BufferClassStats> Stats() const
+    {
+        static const char *names[] = {"Vertex", "Index", "Uniform"};
+
+        std::vector<BufferClassStats> stats;
+        for (uint32_t classIndex = 0; classIndex < static_cast<uint32_t>(BufferClass::Count); ++classIndex)
+        {
+            BufferClassStats classStats{names[classIndex], 0, 0, 0, 0, 0, 0.0f};
+            uint64_t free = 0;
+            for (const Page &page : classes[classIndex].pages)
+            {
+                if (!page.buffer)
+                {
+                    continue;
+                }
+                const auto pageStats = page.allocator.GetStats();
+                classStats.pages++;
+                classStats.allocations += pageStats.allocations;
+                classStats.capacity += pageStats.capacity;
+                classStats.used += pageStats.used;
+                classStats.largestFree = std::max(classStats.largestFree, pageStats.largestFree);
+                free += pageStats.capacity - pageStats.used;
+            }
+            classStats.fragmentation = free == 0 ? 0.0f : 1.0f - static_cast<float>(classStats.largestFree) / static_cast<float>(free);
+            stats.push_back(classStats);
+        }
+        return stats;
+    }
+
+    void PrintStats(std::ostream &out) const
+    {
+        for (const auto &stat : Stats())
+        {
+            if (stat.pages > 0)
+            {
+                out << stat.name << " pool: " << stat.pages << " pages, " << stat.allocations << " ranges, "
+                    << stat.used << "/" << stat.capacity << " bytes, fragmentation " << stat.fragmentation << std::endl;
+            }
+        }
+        if (defragmentations > 0)
+        {
+            out << "Buffer pool: " << defragmentations << " pages compacted" << std::endl;
+        }
+    }
+
+    void Terminate()
+    {
+        for (Class &bufferClass : classes)
+        {
+            for (Page &page : bufferClass.pages)
+            {
+                resources.Release(page.buffer);
+            }
+            bufferClass.pages.clear();
+        }
+    }
+
+private:
+    struct Page
+    {
+        Handle<Buffer> buffer;
+        TlsfAllocator allocator;
+        uint32_t version = 0;
+        bool dedicated = false;
+    };
+
+    struct Class
+    {
+        std::vector<Page> pages;
+        uint64_t pageSize = 0;
+        uint64_t granularity = 16;
+    };
+
+    Page &PageOf(const BufferRange &range)
+    {
+        return classes[static_cast<uint32_t>(range.usage)].pages[range.page];
+    }
+
+    Handle<Buffer> CreateBuffer(BufferClass usage, uint64_t size)
+    {
+        static const char *labels[] = {"Vertex pool page", "Index pool page", "Uniform pool page"};
+        static const WGPUBufferUsageFlags usages[] = {BufferUsage::Vertex, BufferUsage::Index, BufferUsage::Uniform};
+
+        BufferDescriptor bufferDesc;
+        bufferDesc.label = labels[static_cast<uint32_t>(usage)];
+        bufferDesc.size = size;
+        bufferDesc.usage = usages[static_cast<uint32_t>(usage)] | BufferUsage::CopyDst | BufferUsage::CopySrc;
+        bufferDesc.mappedAtCreation = false;
+        return resources.CreateBuffer(device, bufferDesc);
+    }
+
+    uint32_t CreatePage(BufferClass usage, uint64_t capacity, bool dedicated)
+    {
+        Class &bufferClass = classes[static_cast<uint32_t>(usage)];
+
+        Page page;
+        page.buffer = CreateBuffer(usage, capacity);
+        page.allocator = TlsfAllocator(capacity, bufferClass.granularity);
+        page.dedicated = dedicated;
+
+        // Reuse the slot of a released dedicated page
+        for (uint32_t pageIndex = 0; pageIndex < bufferClass.pages.size(); ++pageIndex)
+        {
+            if (!bufferClass.pages[pageIndex].buffer)
+            {
+                page.version = bufferClass.pages[pageIndex].version + 1;
+                bufferClass.pages[pageIndex] = std::move(page);
+                return pageIndex;
+            }
+        }
+
+        bufferClass.pages.push_back(std::move(page));
+        return static_cast<uint32_t>(bufferClass.pages.size() - 1);
+    }
+
+    ResourceRegistry &resources;
+    Device device = nullptr;
+    Queue queue = nullptr;
+    uint64_t maxBufferSize = 0;
+    uint64_t defragmentations = 0;
+    Class classes[static_cast<uint32_t>(BufferClass::Count)];
+};
@@ -0,0 +1,74 @@
+export module camera;
+
+import <algorithm>;
+import <cmath>;
+
+import input;
+import loader;
+
+// First person fly camera: mouse deltas turn it, the movement actions of
+// input.json move it along the view direction. Runs once per tick on the
+// input state of that tick.
+export class CameraController
+{
+public:
+    // Resolves the movement actions, call once input.json is loaded
+    void Bind(const Input &input)
+    {
+        forward = input.Action("forward");
+        backward = input.Action("backward");
+        left = input.Action("left");
+        right = input.Action("right");
+        up = input.Action("up");
+        down = input.Action("down");
+    }
+
+    void Update(const Input &input, float deltaTime)
+    {
+        yaw += static_cast<float>(input.MouseDeltaX()) * sensitivity;
+        pitch -= static_cast<float>(input.MouseDeltaY()) * sensitivity;
+        pitch = std::clamp(pitch, -glm::radians(89.0f), glm::radians(89.0f));
+
+        const vec3 front = glm::normalize(vec3(std::sin(yaw) * std::cos(pitch), std::sin(pitch), std::cos(yaw) * std::cos(pitch)));
+        const vec3 worldUp = vec3(0.0f, 1.0f, 0.0f);
+        // Left handed, x is to the right of z
+        const vec3 side = glm::normalize(glm::cross(worldUp, front));
+
+        vec3 move(0.0f);
+        move += front * Axis(input, forward, backward);
+        move += side * Axis(input, right, left);
+        move += worldUp * Axis(input, up, down);
+        if (glm::dot(move, move) > 0.0f)
+        {
+            position += glm::normalize(move) * speed * deltaTime;
+        }
+
+        viewMatrix = glm::lookAt(position, position + front, glm::normalize(glm::cross(front, side)));
+    }
+
+    const mat4x4 &ViewMatrix() const
+    {
+        return viewMatrix;
+    }
+
+    vec3 position = vec3(0.0f);
+    float yaw = 0.0f;
+    float pitch = 0.0f;
+    // Radians per mouse count and units per second
+    float sensitivity = 0.005f;
+    float speed = 2.0f;
+
+private:
+    static float Axis(const Input &input, ActionId positive, ActionId negative)
+    {
+        return (input.IsPressed(positive) ? 1.0f : 0.0f) - (input.IsPressed(negative) ? 1.0f : 0.0f);
+    }
+
+    ActionId forward = noAction;
+    ActionId backward = noAction;
+    ActionId left = noAction;
+    ActionId right = noAction;
+    ActionId up = noAction;
+    ActionId down = noAction;
+    mat4x4 viewMatrix = mat4x4(1.0f);
+};
@@ -0,0 +1,184 @@
+module;
+
+#include <webgpu/webgpu.hpp>
+
+export module capabilities;
+
+import <algorithm>;
+import <cstdint>;
+import <string>;
+import <vector>;
+
+import logging;
+
+using namespace wgpu;
+
+// What the engine's enabled subsystems need from the device. Size limits are
+// requested up to the adapter maximum (capped by the desired value), count
+// limits at exactly what is used so a weaker adapter fails early and clearly.
+export struct EngineRequirements
+{
+    uint64_t minBufferSize = 16ull << 20;
+    uint64_t desiredBufferSize = 2ull << 30;
+    uint64_t minUniformBufferBindingSize = 16ull << 10;
+    uint64_t desiredUniformBufferBindingSize = 64ull << 10;
+    uint64_t minStorageBufferBindingSize = 0;
+    uint64_t desiredStorageBufferBindingSize = 1ull << 30;
+    uint32_t minTextureDimension2D = 4096;
+    uint32_t bindGroups = 4;
+    uint32_t vertexBuffers = 2;
+    uint32_t vertexAttributes = 8;
+    uint32_t vertexBufferArrayStride = 256;
+    uint32_t interStageShaderComponents = 16;
+    uint32_t uniformBuffersPerShaderStage = 4;
+    // The shape renderer binds its shapes and tile lists
+    uint32_t storageBuffersPerShaderStage = 2;
+    uint32_t sampledTexturesPerShaderStage = 4;
+    uint32_t samplersPerShaderStage = 2;
+    std::vector<WGPUFeatureName> requiredFeatures;
+    std::vector<WGPUFeatureName> optionalFeatures = {WGPUFeatureName_TimestampQuery};
+};
+
+export class DeviceCapabilities
+{
+public:
+    // Fills the device request from the adapter's limits and features. Check
+    // Valid() before using the result.
+    static DeviceCapabilities Negotiate(Adapter adapter, const EngineRequirements &requirements)
+    {
+        DeviceCapabilities caps;
+        adapter.getLimits(&caps.adapterLimits);
+        const Limits &supported = caps.adapterLimits.limits;
+
+        Limits &limits = caps.requiredLimits.limits;
+
+        caps.RequestSize(limits.maxBufferSize, supported.maxBufferSize, requirements.minBufferSize, requirements.desiredBufferSize, "maxBufferSize");
+        caps.RequestSize(limits.maxUniformBufferBindingSize, supported.maxUniformBufferBindingSize, requirements.minUniformBufferBindingSize, requirements.desiredUniformBufferBindingSize, "maxUniformBufferBindingSize");
+        caps.RequestSize(limits.maxStorageBufferBindingSize, supported.maxStorageBufferBindingSize, requirements.minStorageBufferBindingSize, requirements.desiredStorageBufferBindingSize, "maxStorageBufferBindingSize");
+        caps.RequestSize(limits.maxTextureDimension2D, supported.maxTextureDimension2D, requirements.minTextureDimension2D, supported.maxTextureDimension2D, "maxTextureDimension2D");
+
+        caps.RequestCount(limits.maxBindGroups, supported.maxBindGroups, requirements.bindGroups, "maxBindGroups");
+        caps.RequestCount(limits.maxVertexBuffers, supported.maxVertexBuffers, requirements.vertexBuffers, "maxVertexBuffers");
+        caps.RequestCount(limits.maxVertexAttributes, supported.maxVertexAttributes, requirements.vertexAttributes, "maxVertexAttributes");
+        caps.RequestCount(limits.maxVertexBufferArrayStride, supported.maxVertexBufferArrayStride, requirements.vertexBufferArrayStride, "maxVertexBufferArrayStride");
+        caps.RequestCount(limits.maxInterStageShaderComponents, supported.maxInterStageShaderComponents, requirements.interStageShaderComponents, "maxInterStageShaderComponents");
+        caps.RequestCount(limits.maxUniformBuffersPerShaderStage, supported.maxUniformBuffersPerShaderStage, requirements.uniformBuffersPerShaderStage, "maxUniformBuffersPerShaderStage");
+        caps.RequestCount(limits.maxStorageBuffersPerShaderStage, supported.maxStorageBuffersPerShaderStage, requirements.storageBuffersPerShaderStage, "maxStorageBuffersPerShaderStage");
+        caps.RequestCount(limits.maxSampledTexturesPerShaderStage, supported.maxSampledTexturesPerShaderStage, requirements.sampledTexturesPerShaderStage, "maxSampledTexturesPerShaderStage");
+        caps.RequestCount(limits.maxSamplersPerShaderStage, supported.maxSamplersPerShaderStage, requirements.samplersPerShaderStage, "maxSamplersPerShaderStage");
+
+        // Alignments are "minimum" limits, the adapter's value is always the best
+        limits.minUniformBufferOffsetAlignment = supported.minUniformBufferOffsetAlignment;
+        limits.minStorageBufferOffsetAlignment = supported.minStorageBufferOffsetAlignment;
+
+        std::vector<WGPUFeatureName> available(wgpuAdapterEnumerateFeatures(adapter, nullptr));
+        wgpuAdapterEnumerateFeatures(adapter, available.data());
+
+        const auto isAvailable = [&](WGPUFeatureName feature)
+        {
+            return std::find(available.begin(), available.end(), feature) != available.end();
+        };
+
+        for (WGPUFeatureName feature : requirements.requiredFeatures)
+        {
+            if (!isAvailable(feature))
+            {
+                caps.errors.push_back("missing required feature " + std::to_string(static_cast<int>(feature)));
+            }
+            caps.features.push_back(feature);
+        }
+
+        for (WGPUFeatureName feature : requirements.optionalFeatures)
+        {
+            if (isAvailable(feature))
+            {
+                caps.features.push_back(feature);
+            }
+        }
+
+        caps.negotiated = limits;
+        return caps;
+    }
+
+    // Replaces the requested values by what the device actually granted.
+    void Update(Device device)
+    {
+        SupportedLimits deviceLimits;
+        device.getLimits(&deviceLimits);
+        negotiated = deviceLimits.limits;
+    }
+
+    bool Valid() const
+    {
+        return errors.empty();
+    }
+
+    void LogErrors() const
+    {
+        for (const auto &error : errors)
+        {
+            LogError("Adapter cannot satisfy engine requirements: {}", error);
+        }
+    }
+
+    const Limits &GetLimits() const
+    {
+        return negotiated;
+    }
+
+    const Limits &AdapterLimits() const
+    {
+        return adapterLimits.limits;
+    }
+
+    bool HasFeature(WGPUFeatureName feature) const
+    {
+        return std::find(features.begin(), features.end(), feature) != features.end();
+    }
+
+    // Largest chunk a subsystem should put in one buffer
+    uint64_t BufferChunkSize(uint64_t desired) const
+    {
+        return std::min(desired, negotiated.maxBufferSize);
+    }
+
+    // Per-instance data can live in a storage buffer read by the vertex stage
+    // instead of an instance-rate vertex buffer
+    bool SupportsStorageInstancing(uint64_t instanceDataSize) const
+    {
+        return negotiated.maxStorageBuffersPerShaderStage > 0 && negotiated.maxStorageBufferBindingSize >= instanceDataSize;
+    }
+
+    RequiredLimits requiredLimits = Default;
+    std::vector<WGPUFeatureName> features;
+
+private:
+    template <typename T>
+    void RequestSize(T &required, T supported, uint64_t minimum, uint64_t desired, const char *name)
+    {
+        if (supported < minimum)
+        {
+            errors.push_back(std::string(name) + " is " + std::to_string(supported) + ", need " + std::to_string(minimum));
+        }
+        required = static_cast<T>(std::min<uint64_t>(desired, supported));
+    }
+
+    template <typename T>
+    void RequestCount(T &required, T supported, uint32_t needed, const char *name)
+    {
+        // Unused, leave it at the default
+        if (needed == 0)
+        {
+            return;
+        }
+        if (supported < needed)
+        {
+            errors.push_back(std::string(name) + " is " + std::to_string(supported) + ", need " + std::to_string(needed));
+        }
+        required = std::min<T>(needed, supported);
+    }
+
+    SupportedLimits adapterLimits;
+    Limits negotiated;
+    std::vector<std::string> errors;
+};
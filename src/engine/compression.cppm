@@ -0,0 +1,310 @@
+module;
+
+#ifdef SHADY_WITH_LZ4
+#include <lz4.h>
+#include <lz4hc.h>
+#endif
+
+#ifdef SHADY_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+export module compression;
+
+import <algorithm>;
+import <atomic>;
+import <cstddef>;
+import <cstdint>;
+import <cstring>;
+import <span>;
+import <string_view>;
+import <vector>;
+
+import archive;
+import jobs;
+
+// Chunked container for compressed blobs:
+//
+//   ChunkedHeader
+//   ChunkInfo[chunkCount]
+//   compressed chunks
+//
+// Every chunk decompresses on its own into a fixed slot of the output, so a
+// blob can be decompressed by several jobs at once, or piecewise into memory
+// handed out chunk by chunk (staging buffers).
+
+export constexpr uint32_t chunkedMagic = 0x4B4E4843; // "CHNK"
+export constexpr uint32_t defaultCompressionChunkSize = 256u << 10;
+
+export struct ChunkedHeader
+{
+    uint32_t magic = chunkedMagic;
+    Compression codec = Compression::None;
+    uint32_t chunkSize = 0;
+    uint32_t chunkCount = 0;
+    uint64_t rawSize = 0;
+    uint64_t reserved = 0;
+};
+
+export struct ChunkInfo
+{
+    uint64_t offset = 0;
+    uint32_t storedSize = 0;
+    uint32_t rawSize = 0;
+};
+
+static_assert(sizeof(ChunkedHeader) == 32);
+static_assert(sizeof(ChunkInfo) == 16);
+
+export constexpr bool CompressionAvailable(Compression codec)
+{
+    switch (codec)
+    {
+    case Compression::None:
+        return true;
+    case Compression::LZ4:
+#ifdef SHADY_WITH_LZ4
+        return true;
+#else
+        return false;
+#endif
+    case Compression::Zstd:
+#ifdef SHADY_WITH_ZSTD
+        return true;
+#else
+        return false;
+#endif
+    }
+    return false;
+}
+
+export constexpr std::string_view CompressionName(Compression codec)
+{
+    switch (codec)
+    {
+    case Compression::None:
+        return "raw";
+    case Compression::LZ4:
+        return "lz4";
+    case Compression::Zstd:
+        return "zstd";
+    }
+    return "unknown";
+}
+
+// Decompresses exactly destination.size() bytes, false on corrupt input or a
+// codec this build does not have.
+export bool DecompressChunk(Compression codec, std::span<const std::byte> source, std::span<std::byte> destination)
+{
+    switch (codec)
+    {
+    case Compression::None:
+        if (source.size() != destination.size())
+        {
+            return false;
+        }
+        std::memcpy(destination.data(), source.data(), source.size());
+        return true;
+    case Compression::LZ4:
+#ifdef SHADY_WITH_LZ4
+        return LZ4_decompress_safe(reinterpret_cast<const char *>(source.data()), reinterpret_cast<char *>(destination.data()),
+                                   static_cast<int>(source.size()), static_cast<int>(destination.size())) == static_cast<int>(destination.size());
+#else
+        return false;
+#endif
+    case Compression::Zstd:
+#ifdef SHADY_WITH_ZSTD
+    {
+        const size_t result = ZSTD_decompress(destination.data(), destination.size(), source.data(), source.size());
+        return !ZSTD_isError(result) && result == destination.size();
+    }
+#else
+        return false;
+#endif
+    }
+    return false;
+}
+
+// Compresses raw into a chunked container. Chunks that do not shrink are
+// stored raw, falls back to Compression::None for codecs not built in.
+export std::vector<std::byte> CompressChunked(std::span<const std::byte> raw, Compression codec, uint32_t chunkSize = defaultCompressionChunkSize)
+{
+    if (!CompressionAvailable(codec))
+    {
+        codec = Compression::None;
+    }
+
+    ChunkedHeader header;
+    header.codec = codec;
+    header.chunkSize = chunkSize;
+    header.chunkCount = static_cast<uint32_t>((raw.size() + chunkSize - 1) / chunkSize);
+    header.rawSize = raw.size();
+
+    std::vector<ChunkInfo> chunks(header.chunkCount);
+    std::vector<std::byte> payload;
+    std::vector<std::byte> scratch;
+
+    const uint64_t payloadOffset = sizeof(ChunkedHeader) + chunks.size() * sizeof(ChunkInfo);
+    for (uint32_t i = 0; i < header.chunkCount; ++i)
+    {
+        const auto source = raw.subspan(uint64_t(i) * chunkSize, std::min<uint64_t>(chunkSize, raw.size() - uint64_t(i) * chunkSize));
+
+        size_t compressedSize = 0;
+        switch (codec)
+        {
+        case Compression::None:
+            break;
+        case Compression::LZ4:
+#ifdef SHADY_WITH_LZ4
+            scratch.resize(LZ4_compressBound(static_cast<int>(source.size())));
+            compressedSize = LZ4_compress_HC(reinterpret_cast<const char *>(source.data()), reinterpret_cast<char *>(scratch.data()),
+                                             static_cast<int>(source.size()), static_cast<int>(scratch.size()), LZ4HC_CLEVEL_DEFAULT);
+#endif
+            break;
+        case Compression::Zstd:
+#ifdef SHADY_WITH_ZSTD
+        {
+            scratch.resize(ZSTD_compressBound(source.size()));
+            const size_t result = ZSTD_compress(scratch.data(), scratch.size(), source.data(), source.size(), 19);
+            compressedSize = ZSTD_isError(result) ? 0 : result;
+        }
+#endif
+            break;
+        }
+
+        chunks[i].offset = payloadOffset + payload.size();
+        chunks[i].rawSize = static_cast<uint32_t>(source.size());
+        if (compressedSize > 0 && compressedSize < source.size())
+        {
+            chunks[i].storedSize = static_cast<uint32_t>(compressedSize);
+            payload.insert(payload.end(), scratch.begin(), scratch.begin() + compressedSize);
+        }
+        else
+        {
+            // Incompressible, a stored size equal to the raw size means raw
+            chunks[i].storedSize = chunks[i].rawSize;
+            payload.insert(payload.end(), source.begin(), source.end());
+        }
+    }
+
+    std::vector<std::byte> blob(payloadOffset + payload.size());
+    std::memcpy(blob.data(), &header, sizeof(header));
+    if (!chunks.empty())
+    {
+        std::memcpy(blob.data() + sizeof(header), chunks.data(), chunks.size() * sizeof(ChunkInfo));
+    }
+    std::copy(payload.begin(), payload.end(), blob.begin() + payloadOffset);
+    return blob;
+}
+
+// Read-only view over a chunked container.
+export class ChunkedBlob
+{
+public:
+    bool Parse(std::span<const std::byte> inBytes)
+    {
+        bytes = {};
+        chunks = {};
+
+        if (inBytes.size() < sizeof(ChunkedHeader))
+        {
+            return false;
+        }
+        std::memcpy(&header, inBytes.data(), sizeof(header));
+
+        const uint64_t tableEnd = sizeof(ChunkedHeader) + uint64_t(header.chunkCount) * sizeof(ChunkInfo);
+        if (header.magic != chunkedMagic || header.chunkSize == 0 || tableEnd > inBytes.size() ||
+            (header.rawSize + header.chunkSize - 1) / header.chunkSize != header.chunkCount)
+        {
+            return false;
+        }
+
+        chunks.resize(header.chunkCount);
+        if (!chunks.empty())
+        {
+            std::memcpy(chunks.data(), inBytes.data() + sizeof(ChunkedHeader), chunks.size() * sizeof(ChunkInfo));
+        }
+        for (uint32_t i = 0; i < header.chunkCount; ++i)
+        {
+            const uint64_t expected = std::min<uint64_t>(header.chunkSize, header.rawSize - uint64_t(i) * header.chunkSize);
+            if (chunks[i].offset + chunks[i].storedSize > inBytes.size() || chunks[i].rawSize != expected)
+            {
+                chunks.clear();
+                return false;
+            }
+        }
+
+        bytes = inBytes;
+        return true;
+    }
+
+    uint64_t RawSize() const
+    {
+        return header.rawSize;
+    }
+
+    uint32_t ChunkSize() const
+    {
+        return header.chunkSize;
+    }
+
+    uint32_t ChunkCount() const
+    {
+        return header.chunkCount;
+    }
+
+    Compression Codec() const
+    {
+        return header.codec;
+    }
+
+    // Stored bytes of all chunks, what actually has to come off the disk
+    uint64_t StoredSize() const
+    {
+        return bytes.size();
+    }
+
+    // destination must hold the chunk's raw size
+    bool DecompressChunk(uint32_t index, std::span<std::byte> destination) const
+    {
+        const ChunkInfo &chunk = chunks[index];
+        if (destination.size() != chunk.rawSize)
+        {
+            return false;
+        }
+        const auto source = bytes.subspan(chunk.offset, chunk.storedSize);
+        const Compression codec = chunk.storedSize == chunk.rawSize ? Compression::None : header.codec;
+        return ::DecompressChunk(codec, source, destination);
+    }
+
+    // Decompresses chunks [first, first + count) into destination, which maps
+    // to raw offset first * ChunkSize(). Chunks run in parallel on the jobs.
+    bool Decompress(JobSystem &jobs, uint32_t first, uint32_t count, std::span<std::byte> destination) const
+    {
+        std::atomic<bool> ok = true;
+        const uint64_t base = uint64_t(first) * header.chunkSize;
+        jobs.ParallelFor(count, 1, [&](size_t begin, size_t end)
+                         {
+            for (size_t i = begin; i < end; ++i)
+            {
+                const uint32_t index = first + static_cast<uint32_t>(i);
+                const uint64_t offset = uint64_t(index) * header.chunkSize - base;
+                if (offset + chunks[index].rawSize > destination.size() ||
+                    !DecompressChunk(index, destination.subspan(offset, chunks[index].rawSize)))
+                {
+                    ok.store(false, std::memory_order_relaxed);
+                }
+            } });
+        return ok.load();
+    }
+
+    bool Decompress(JobSystem &jobs, std::span<std::byte> destination) const
+    {
+        return destination.size() == header.rawSize && Decompress(jobs, 0, header.chunkCount, destination);
+    }
+
+private:
+    ChunkedHeader header;
+    std::span<const std::byte> bytes;
+    std::vector<ChunkInfo> chunks;
+};
@@ -0,0 +1,169 @@
+export module culling;
+
+import <algorithm>;
+import <cmath>;
+import <cstdint>;
+import <ostream>;
+import <span>;
+import <vector>;
+
+import loader;
+
+export struct DrawRange
+{
+    uint32_t firstIndex;
+    uint32_t indexCount;
+};
+
+// Totals over every CullMeshlets call it was passed to, frames counts the
+// calls (the app culls its one mesh once per frame)
+export struct CullStats
+{
+    uint64_t frames = 0;
+    uint64_t meshlets = 0;
+    uint64_t frustumCulled = 0;
+    uint64_t coneCulled = 0;
+    uint64_t draws = 0;
+
+    void PrintStats(std::ostream &out) const
+    {
+        if (frames == 0 || meshlets == 0)
+        {
+            return;
+        }
+        const double total = static_cast<double>(meshlets);
+        out << "Culling: " << total / static_cast<double>(frames) << " meshlets per frame, " << 100.0 * static_cast<double>(frustumCulled) / total
+            << "% outside the frustum, " << 100.0 * static_cast<double>(coneCulled) / total << "% facing away, "
+            << static_cast<double>(draws) / static_cast<double>(frames) << " draws per frame" << std::endl;
+    }
+};
+
+// Planes of a view-projection matrix in world space, pointing inwards. Uses
+// the WebGPU clip volume (0 <= z <= w).
+export class Frustum
+{
+public:
+    explicit Frustum(const mat4x4 &viewProjection)
+    {
+        const mat4x4 m = glm::transpose(viewProjection);
+        planes[0] = m[3] + m[0];
+        planes[1] = m[3] - m[0];
+        planes[2] = m[3] + m[1];
+        planes[3] = m[3] - m[1];
+        planes[4] = m[2];
+        planes[5] = m[3] - m[2];
+
+        for (vec4 &plane : planes)
+        {
+            plane /= glm::length(vec3(plane));
+        }
+    }
+
+    bool Intersects(vec3 center, float radius) const
+    {
+        for (const vec4 &plane : planes)
+        {
+            if (glm::dot(vec3(plane), center) + plane.w < -radius)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    vec4 planes[6];
+};
+
+// Largest axis scale of a model matrix, how much bounds have to grow
+float MaxScale(const mat4x4 &model)
+{
+    return std::sqrt(std::max({glm::dot(vec3(model[0]), vec3(model[0])),
+                               glm::dot(vec3(model[1]), vec3(model[1])),
+                               glm::dot(vec3(model[2]), vec3(model[2]))}));
+}
+
+// Coarsest LOD whose error projects to at most pixelThreshold pixels on a
+// viewport viewportHeight pixels high. The distance is taken to the nearest
+// point of the bounding sphere so the choice is conservative.
+export uint32_t SelectLod(std::span<const Loader::MeshLod> lods, const mat4x4 &model, vec3 cameraPosition, const mat4x4 &projection,
+                          float viewportHeight, float pixelThreshold = 1.0f)
+{
+    if (lods.size() <= 1)
+    {
+        return 0;
+    }
+
+    const float scale = MaxScale(model);
+    const vec3 center = vec3(model * vec4(vec3(lods[0].sphere), 1.0f));
+    const float distance = std::max(glm::length(center - cameraPosition) - lods[0].sphere.w * scale, 1e-3f);
+
+    // Clip w grows with view depth by projection[2][3], zero for orthographic
+    const float depthScale = std::abs(projection[2][3]) > 0.0f ? std::abs(projection[2][3]) * distance : 1.0f;
+    const float pixelsPerUnit = std::abs(projection[1][1]) / depthScale * viewportHeight * 0.5f;
+
+    for (uint32_t lod = static_cast<uint32_t>(lods.size()) - 1; lod > 0; --lod)
+    {
+        if (lods[lod].error * scale * pixelsPerUnit <= pixelThreshold)
+        {
+            return lod;
+        }
+    }
+    return 0;
+}
+
+// Appends the index ranges of the meshlets that may be visible, merging
+// neighbours into a single draw. Bounds are transformed by the model matrix.
+export void CullMeshlets(std::span<const Loader::Meshlet> meshlets, const mat4x4 &model, const Frustum &frustum, vec3 cameraPosition,
+                         std::vector<DrawRange> &draws, CullStats *stats = nullptr)
+{
+    const float scale = MaxScale(model);
+    const glm::mat3 normalMatrix = glm::inverseTranspose(glm::mat3(model));
+
+    const size_t firstDraw = draws.size();
+    for (const Loader::Meshlet &meshlet : meshlets)
+    {
+        const vec3 center = vec3(model * vec4(vec3(meshlet.sphere), 1.0f));
+        const float radius = meshlet.sphere.w * scale;
+
+        if (!frustum.Intersects(center, radius))
+        {
+            if (stats)
+            {
+                stats->frustumCulled++;
+            }
+            continue;
+        }
+
+        // Every triangle faces away when the eye is inside the cone's back side
+        if (meshlet.cone.w < 1.0f)
+        {
+            const vec3 axis = glm::normalize(normalMatrix * vec3(meshlet.cone));
+            const vec3 toCenter = center - cameraPosition;
+            if (glm::dot(toCenter, axis) >= meshlet.cone.w * glm::length(toCenter) + radius)
+            {
+                if (stats)
+                {
+                    stats->coneCulled++;
+                }
+                continue;
+            }
+        }
+
+        if (draws.size() > firstDraw && draws.back().firstIndex + draws.back().indexCount == meshlet.firstIndex)
+        {
+            draws.back().indexCount += meshlet.indexCount;
+        }
+        else
+        {
+            draws.push_back({meshlet.firstIndex, meshlet.indexCount});
+        }
+    }
+
+    if (stats)
+    {
+        stats->frames++;
+        stats->meshlets += meshlets.size();
+        stats->draws += draws.size() - firstDraw;
+    }
+}
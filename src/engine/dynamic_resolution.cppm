@@ -0,0 +1,115 @@
+export module dynamic_resolution;
+
+import <algorithm>;
+import <cmath>;
+import <cstdint>;
+import <ostream>;
+
+export struct RenderSize
+{
+    uint32_t width;
+    uint32_t height;
+
+    bool operator==(const RenderSize &) const = default;
+};
+
+// Picks the scale of the offscreen scene resolution from measured GPU time.
+// Cost follows the pixel count, so the square of the scale. Over budget it
+// drops straight to where the budget fits with some headroom, it only grows
+// back in small steps once well under budget, and the band in between leaves
+// the scale alone so it does not oscillate. After every change it waits for
+// measurements taken at the new scale, they arrive a few frames late.
+export class ResolutionController
+{
+public:
+    // Sizes are rounded up to this many pixels so a few sizes keep recurring
+    // and their render targets stay cached
+    static constexpr uint32_t sizeAlignment = 8;
+
+    void Update(double gpuMilliseconds)
+    {
+        if (budget <= 0.0)
+        {
+            scale = maxScale;
+            return;
+        }
+
+        smoothed = samples == 0 ? gpuMilliseconds : smoothed + (gpuMilliseconds - smoothed) * smoothing;
+        samples++;
+        scaleSum += scale;
+
+        if (cooldown > 0)
+        {
+            cooldown--;
+            return;
+        }
+
+        float target = scale;
+        const float fit = scale * static_cast<float>(std::sqrt(budget * headroom / smoothed));
+        if (smoothed > budget)
+        {
+            target = std::max(fit, scale - maxStepDown);
+        }
+        else if (smoothed < budget * growBelow)
+        {
+            target = std::min(fit, scale + maxStepUp);
+        }
+
+        target = std::clamp(std::round(target * scaleSteps) / scaleSteps, minScale, maxScale);
+        if (target != scale)
+        {
+            // Predict the cost at the new scale until real measurements come in
+            smoothed *= (target * target) / (scale * scale);
+            scale = target;
+            cooldown = settleSamples;
+            changes++;
+        }
+    }
+
+    float Scale() const
+    {
+        return scale;
+    }
+
+    RenderSize Size(uint32_t outputWidth, uint32_t outputHeight) const
+    {
+        const auto scaled = [&](uint32_t size)
+        {
+            const uint32_t aligned = (static_cast<uint32_t>(std::ceil(static_cast<float>(size) * scale)) + sizeAlignment - 1) / sizeAlignment * sizeAlignment;
+            return std::clamp(aligned, 1u, size);
+        };
+        return {scaled(outputWidth), scaled(outputHeight)};
+    }
+
+    void PrintStats(std::ostream &out) const
+    {
+        if (samples == 0 || budget <= 0.0)
+        {
+            return;
+        }
+        out << "Dynamic resolution: budget " << budget << " ms, GPU " << smoothed << " ms, scale " << scale << ", average "
+            << scaleSum / static_cast<double>(samples) << ", " << changes << " changes" << std::endl;
+    }
+
+    // Milliseconds of GPU time for the scaled passes, 0 disables scaling
+    double budget = 12.0;
+    float minScale = 0.5f;
+    float maxScale = 1.0f;
+
+private:
+    static constexpr double smoothing = 0.2;
+    // Where a resize aims at, and below which the scale may grow
+    static constexpr double headroom = 0.85;
+    static constexpr double growBelow = 0.7;
+    static constexpr float maxStepDown = 0.25f;
+    static constexpr float maxStepUp = 0.05f;
+    static constexpr float scaleSteps = 32.0f;
+    static constexpr uint32_t settleSamples = 6;
+
+    float scale = 1.0f;
+    double smoothed = 0.0;
+    uint64_t samples = 0;
+    double scaleSum = 0.0;
+    uint32_t cooldown = 0;
+    uint64_t changes = 0;
+};
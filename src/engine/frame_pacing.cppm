@@ -0,0 +1,206 @@
+module;
+
+#include <webgpu/webgpu.hpp>
+
+export module frame_pacing;
+
+import <algorithm>;
+import <chrono>;
+import <cmath>;
+import <cstdint>;
+import <ostream>;
+import <span>;
+import <string_view>;
+import <thread>;
+import <vector>;
+
+using namespace wgpu;
+
+struct PresentModeInfo
+{
+    WGPUPresentMode mode;
+    const char *name;
+};
+
+constexpr PresentModeInfo presentModes[] = {
+    {WGPUPresentMode_Fifo, "fifo"},
+    {WGPUPresentMode_FifoRelaxed, "relaxed"},
+    {WGPUPresentMode_Mailbox, "mailbox"},
+    {WGPUPresentMode_Immediate, "immediate"},
+};
+
+export const char *PresentModeName(PresentMode mode)
+{
+    for (const PresentModeInfo &info : presentModes)
+    {
+        if (info.mode == mode)
+        {
+            return info.name;
+        }
+    }
+    return "unknown";
+}
+
+export bool ParsePresentMode(std::string_view name, PresentMode &mode)
+{
+    for (const PresentModeInfo &info : presentModes)
+    {
+        if (name == info.name)
+        {
+            mode = info.mode;
+            return true;
+        }
+    }
+    return false;
+}
+
+// The requested mode if the surface supports it, else the closest one:
+// Immediate (uncapped, tears) falls back to Mailbox (uncapped, no tearing),
+// Mailbox and FifoRelaxed to Fifo, which every surface has.
+export PresentMode ChoosePresentMode(PresentMode requested, std::span<const PresentMode> supported)
+{
+    const auto isSupported = [&](WGPUPresentMode mode)
+    { return std::find(supported.begin(), supported.end(), mode) != supported.end(); };
+
+    std::vector<WGPUPresentMode> candidates = {requested};
+    if (requested == PresentMode::Immediate)
+    {
+        candidates.push_back(WGPUPresentMode_Mailbox);
+    }
+    candidates.push_back(WGPUPresentMode_Fifo);
+
+    for (WGPUPresentMode mode : candidates)
+    {
+        if (isSupported(mode))
+        {
+            return mode;
+        }
+    }
+    return PresentMode::Fifo;
+}
+
+// Holds frames to a fixed rate below what the present mode allows, for stable
+// pacing at lower power. Wait sleeps to just before the frame's deadline and
+// spins the rest, the spin margin follows how late the OS wakes the thread.
+// With Fifo the rate should divide the refresh rate, anything else alternates
+// between refresh multiples. Present to present intervals are recorded either
+// way, so uncapped runs get the same jitter numbers.
+export class FramePacer
+{
+public:
+    // 0 or less disables pacing
+    void SetTargetRate(double framesPerSecond)
+    {
+        period = framesPerSecond > 0.0 ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / framesPerSecond))
+                                       : Clock::duration::zero();
+        deadline = {};
+    }
+
+    double TargetRate() const
+    {
+        return period > Clock::duration::zero() ? 1.0 / std::chrono::duration<double>(period).count() : 0.0;
+    }
+
+    // Call before the frame samples input, it returns at the frame's deadline
+    void Wait()
+    {
+        if (period == Clock::duration::zero())
+        {
+            return;
+        }
+
+        const Clock::time_point now = Clock::now();
+        if (deadline == Clock::time_point{} || now > deadline + period)
+        {
+            // First frame, or more than a frame late: restart the schedule
+            // here instead of rushing frames out to catch up
+            missed += deadline != Clock::time_point{};
+            deadline = now + period;
+            return;
+        }
+        missed += now > deadline;
+
+#ifndef __EMSCRIPTEN__
+        if (now + spinMargin < deadline)
+        {
+            const Clock::time_point wake = deadline - spinMargin;
+            std::this_thread::sleep_until(wake);
+            const Clock::duration late = Clock::now() - wake;
+            spinMargin = std::clamp(std::max(spinMargin - spinMargin / 64, late + late / 4), minSpinMargin, period);
+        }
+        while (Clock::now() < deadline)
+        {
+            std::this_thread::yield();
+        }
+#endif
+        deadline += period;
+    }
+
+    // Call right after present returned
+    void Presented()
+    {
+        const Clock::time_point now = Clock::now();
+        if (lastPresent != Clock::time_point{})
+        {
+            const float interval = std::chrono::duration<float, std::milli>(now - lastPresent).count();
+            if (intervals.size() < maxSamples)
+            {
+                intervals.push_back(interval);
+            }
+            else
+            {
+                intervals[count % maxSamples] = interval;
+            }
+            count++;
+        }
+        lastPresent = now;
+    }
+
+    void PrintStats(std::ostream &out) const
+    {
+        if (intervals.empty())
+        {
+            return;
+        }
+
+        double mean = 0.0;
+        for (float interval : intervals)
+        {
+            mean += interval;
+        }
+        mean /= static_cast<double>(intervals.size());
+
+        double variance = 0.0;
+        std::vector<float> deviations;
+        for (float interval : intervals)
+        {
+            variance += (interval - mean) * (interval - mean);
+            deviations.push_back(static_cast<float>(std::abs(interval - mean)));
+        }
+        variance /= static_cast<double>(intervals.size());
+        std::sort(deviations.begin(), deviations.end());
+
+        out << "Present interval over " << count << " frames: mean " << mean << " ms (" << 1000.0 / mean << " fps), jitter " << std::sqrt(variance)
+            << " ms, p99 deviation " << deviations[static_cast<size_t>(0.99f * static_cast<float>(deviations.size() - 1))] << " ms";
+        if (period > Clock::duration::zero())
+        {
+            out << "; target " << TargetRate() << " fps, " << missed << " deadlines missed";
+        }
+        out << std::endl;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr Clock::duration minSpinMargin = std::chrono::microseconds(200);
+    // The most recent frames, older ones are overwritten
+    static constexpr size_t maxSamples = 4096;
+
+    Clock::duration period = Clock::duration::zero();
+    Clock::time_point deadline;
+    Clock::duration spinMargin = std::chrono::milliseconds(2);
+    Clock::time_point lastPresent;
+    std::vector<float> intervals;
+    uint64_t count = 0;
+    uint64_t missed = 0;
+};
@@ -0,0 +1,170 @@
+module;
+
+#include <webgpu/webgpu.hpp>
+
+export module frame_sync;
+
+import <algorithm>;
+import <chrono>;
+import <cstdint>;
+import <deque>;
+import <memory>;
+import <ostream>;
+import <thread>;
+import <utility>;
+
+using namespace wgpu;
+
+export constexpr uint32_t maxFramesInFlight = 3;
+
+export struct FrameSyncStats
+{
+    uint64_t frames = 0;
+    // Frames whose BeginFrame had to wait for the GPU
+    uint64_t waits = 0;
+    // Seconds
+    double cpuWait = 0.0;
+    double maxCpuWait = 0.0;
+    double gpuIdle = 0.0;
+};
+
+// Bounds how far the CPU runs ahead of the GPU. Per-frame resources come in
+// FramesInFlight() slots and BeginFrame waits until the frame that last used
+// the next slot has completed, so they can be overwritten. One frame in flight
+// gives the lowest latency, input is sampled only once the GPU caught up.
+// Three keep the GPU fed through CPU hitches at the price of queued frames.
+export class FrameSync
+{
+public:
+    FrameSync() {};
+
+    FrameSync(const FrameSync &) = delete;
+    FrameSync &operator=(const FrameSync &) = delete;
+
+    void Initialize(uint32_t inFramesInFlight)
+    {
+        framesInFlight = std::clamp(inFramesInFlight, 1u, maxFramesInFlight);
+    }
+
+    // Waits until fewer than FramesInFlight() frames are on the GPU and
+    // returns the slot of the frame about to be recorded. The browser runs the
+    // completion callbacks only between frames, so the web never waits here.
+    // A blocking poll would wait for all submitted work and drain the queue,
+    // so it sleeps between polls instead, starting short so a frame about to
+    // complete is not overslept and backing off so a long wait does not keep
+    // a core busy.
+    uint32_t BeginFrame(Device &device)
+    {
+#ifndef __EMSCRIPTEN__
+        if (InFlight() >= framesInFlight)
+        {
+            const auto start = Clock::now();
+            auto backoff = minPollInterval;
+            Poll(device);
+            while (InFlight() >= framesInFlight)
+            {
+                std::this_thread::sleep_for(backoff);
+                backoff = std::min(backoff * 2, maxPollInterval);
+                Poll(device);
+            }
+            const double waited = std::chrono::duration<double>(Clock::now() - start).count();
+            stats.waits++;
+            stats.cpuWait += waited;
+            stats.maxCpuWait = std::max(stats.maxCpuWait, waited);
+        }
+#endif
+        return Slot();
+    }
+
+    // Must be called right after the frame's command buffers were submitted
+    void Submit(Queue &queue)
+    {
+        // Everything before was done, the GPU sat idle since the last one
+        // completed. Completion is only seen when polled, so this undercounts.
+        if (frameIndex > 0 && completedFrames == frameIndex)
+        {
+            stats.gpuIdle += std::chrono::duration<double>(Clock::now() - lastCompletion).count();
+        }
+
+        const uint64_t frame = frameIndex++;
+        stats.frames++;
+
+        fences.push_back({frame, queue.onSubmittedWorkDone([this, frame](QueueWorkDoneStatus)
+                                                           {
+                                                               if (frame + 1 > completedFrames)
+                                                               {
+                                                                   completedFrames = frame + 1;
+                                                                   lastCompletion = Clock::now();
+                                                               } })});
+    }
+
+    // Runs pending callbacks (fences, buffer mappings) without blocking, once
+    // per frame is enough, BeginFrame polls itself while it waits
+    void Poll(Device &device)
+    {
+#if defined(WEBGPU_BACKEND_DAWN)
+        device.tick();
+#elif defined(WEBGPU_BACKEND_WGPU)
+        device.poll(false);
+#else
+        (void)device;
+#endif
+
+        while (!fences.empty() && fences.front().first < completedFrames)
+        {
+            fences.pop_front();
+        }
+    }
+
+    uint32_t Slot() const
+    {
+        return static_cast<uint32_t>(frameIndex % framesInFlight);
+    }
+
+    uint32_t FramesInFlight() const
+    {
+        return framesInFlight;
+    }
+
+    uint64_t InFlight() const
+    {
+        return frameIndex - completedFrames;
+    }
+
+    const FrameSyncStats &Stats() const
+    {
+        return stats;
+    }
+
+    void PrintStats(std::ostream &out) const
+    {
+        if (stats.frames == 0)
+        {
+            return;
+        }
+
+        out << "Frames in flight: " << framesInFlight << ", CPU waited for the GPU in " << stats.waits << " of " << stats.frames << " frames, "
+            << stats.cpuWait * 1000.0 << " ms total, max " << stats.maxCpuWait * 1000.0 << " ms; GPU idle at least " << stats.gpuIdle * 1000.0
+            << " ms" << std::endl;
+    }
+
+    // Drops the pending fences, only valid on shutdown
+    void Terminate()
+    {
+        fences.clear();
+        completedFrames = frameIndex;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr std::chrono::microseconds minPollInterval{50};
+    static constexpr std::chrono::microseconds maxPollInterval{1000};
+
+    std::deque<std::pair<uint64_t, std::unique_ptr<QueueWorkDoneCallback>>> fences;
+    uint32_t framesInFlight = 2;
+    uint64_t frameIndex = 0;
+    uint64_t completedFrames = 0;
+    Clock::time_point lastCompletion;
+    FrameSyncStats stats;
+};
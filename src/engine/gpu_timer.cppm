@@ -0,0 +1,180 @@
+module;
+
+#include <webgpu/webgpu.hpp>
+
+export module gpu_timer;
+
+import <array>;
+import <cstdint>;
+import <memory>;
+
+import resources;
+
+using namespace wgpu;
+
+// Measures one render pass per frame with timestamp queries. The results come
+// back through a few readback buffers mapped asynchronously, a frame or two
+// late, frames that find no free buffer are not measured. Without the
+// TimestampQuery feature it stays unavailable and measures nothing.
+export class GpuTimer
+{
+public:
+    explicit GpuTimer(ResourceRegistry &inResources) : resources(inResources) {};
+
+    GpuTimer(const GpuTimer &) = delete;
+    GpuTimer &operator=(const GpuTimer &) = delete;
+
+    void Initialize(Device &device, bool timestampQueries)
+    {
+        if (!timestampQueries)
+        {
+            return;
+        }
+
+        QuerySetDescriptor querySetDesc;
+        querySetDesc.label = "Pass timestamps";
+        querySetDesc.type = QueryType::Timestamp;
+        querySetDesc.count = 2 * slotCount;
+        querySet = resources.Add(device.createQuerySet(querySetDesc), 0, "Pass timestamps");
+
+        BufferDescriptor bufferDesc;
+        bufferDesc.label = "Timestamp resolve";
+        bufferDesc.size = slotCount * resolveStride;
+        bufferDesc.usage = BufferUsage::QueryResolve | BufferUsage::CopySrc;
+        bufferDesc.mappedAtCreation = false;
+        resolveBuffer = resources.CreateBuffer(device, bufferDesc);
+
+        bufferDesc.label = "Timestamp readback";
+        bufferDesc.size = 2 * sizeof(uint64_t);
+        bufferDesc.usage = BufferUsage::MapRead | BufferUsage::CopyDst;
+        for (Slot &slot : slots)
+        {
+            slot.readback = resources.CreateBuffer(device, bufferDesc);
+        }
+    }
+
+    bool Available() const
+    {
+        return static_cast<bool>(querySet);
+    }
+
+    // Timestamp writes for the pass to measure this frame, null when this
+    // frame is not measured
+    const RenderPassTimestampWrites *PassWrites()
+    {
+        current = noSlot;
+        if (!Available())
+        {
+            return nullptr;
+        }
+
+        for (uint32_t i = 0; i < slotCount; ++i)
+        {
+            if (slots[i].state == State::Free)
+            {
+                current = i;
+                writes.querySet = resources.Get(querySet);
+                writes.beginningOfPassWriteIndex = 2 * i;
+                writes.endOfPassWriteIndex = 2 * i + 1;
+                return &writes;
+            }
+        }
+        return nullptr;
+    }
+
+    // In the encoder of the measured pass, after it ended
+    void Resolve(CommandEncoder &encoder)
+    {
+        if (current == noSlot)
+        {
+            return;
+        }
+
+        encoder.resolveQuerySet(resources.Get(querySet), 2 * current, 2, resources.Get(resolveBuffer), current * resolveStride);
+        encoder.copyBufferToBuffer(resources.Get(resolveBuffer), current * resolveStride, resources.Get(slots[current].readback), 0, 2 * sizeof(uint64_t));
+        slots[current].state = State::Recorded;
+    }
+
+    // Right after the submit, reads the timestamps back once the GPU is done
+    void Submitted()
+    {
+        if (current == noSlot || slots[current].state != State::Recorded)
+        {
+            current = noSlot;
+            return;
+        }
+
+        Slot &slot = slots[current];
+        current = noSlot;
+        slot.state = State::Mapping;
+        slot.mapping = resources.Get(slot.readback).mapAsync(MapMode::Read, 0, 2 * sizeof(uint64_t), [this, &slot](BufferMapAsyncStatus status)
+                                                             {
+            Buffer buffer = resources.Get(slot.readback);
+            if (status == BufferMapAsyncStatus::Success && buffer)
+            {
+                const uint64_t *ticks = static_cast<const uint64_t *>(buffer.getConstMappedRange(0, 2 * sizeof(uint64_t)));
+                // Nanoseconds, some drivers report zero or out of order values
+                // for passes that straddle a power state change
+                if (ticks[1] > ticks[0])
+                {
+                    passTime = static_cast<double>(ticks[1] - ticks[0]) * 1e-6;
+                    fresh = true;
+                }
+                buffer.unmap();
+            }
+            slot.state = State::Free; });
+    }
+
+    // Milliseconds of the last measured pass, once per measurement
+    bool TakePassTime(double &milliseconds)
+    {
+        if (!fresh)
+        {
+            return false;
+        }
+        fresh = false;
+        milliseconds = passTime;
+        return true;
+    }
+
+    void Terminate()
+    {
+        for (Slot &slot : slots)
+        {
+            resources.Release(slot.readback);
+        }
+        resources.Release(resolveBuffer);
+        resources.Release(querySet);
+    }
+
+private:
+    enum class State
+    {
+        Free,
+        Recorded,
+        Mapping
+    };
+
+    struct Slot
+    {
+        Handle<Buffer> readback;
+        State state = State::Free;
+        std::unique_ptr<BufferMapCallback> mapping;
+    };
+
+    // More than the frames in flight, a readback is mapped a frame after the
+    // one it measured completed
+    static constexpr uint32_t slotCount = 4;
+    static constexpr uint32_t noSlot = slotCount;
+    // Query resolve offsets must be multiples of 256
+    static constexpr uint64_t resolveStride = 256;
+
+    ResourceRegistry &resources;
+    Handle<QuerySet> querySet;
+    Handle<Buffer> resolveBuffer;
+    std::array<Slot, slotCount> slots;
+    RenderPassTimestampWrites writes;
+    uint32_t current = noSlot;
+    double passTime = 0.0;
+    bool fresh = false;
+};
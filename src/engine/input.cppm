@@ -1,11 +1,49 @@
 export module input;
 
 import <GLFW/glfw3.h>;
-import <fstream>;
 import <nlohmann/json.hpp>;
-import <set>;
+import <algorithm>;
+import <array>;
+import <bitset>;
+import <cstdint>;
+import <memory>;
+import <span>;
+import <string>;
+import <string_view>;
+import <vector>;
+
+import asset_io;
+import logging;
+import spsc_ring;
+
 using json = nlohmann::json;
 
+// Dense index of an action named in input.json, resolved once with
+// Input::Action so queries are a bit test.
+export using ActionId = uint32_t;
+
+export constexpr ActionId maxActions = 64;
+export constexpr ActionId noAction = maxActions;
+
+export enum class InputEventType : uint32_t
+{
+    Key,
+    MouseMove,
+};
+
+// Raw event as the GLFW callbacks saw it, time in glfwGetTime seconds
+export struct InputEvent
+{
+    double time = 0.0;
+    double x = 0.0;
+    double y = 0.0;
+    InputEventType type = InputEventType::Key;
+    int32_t key = 0;
+    int32_t action = 0;
+};
+
+export using InputEventQueue = SpscRing<InputEvent, 1024>;
+
 export class Input
 {
 
@@ -13,56 +51,245 @@ export class Input
 
 private:
     GLFWwindow *window;
-    std::map<int, std::string> mappings;
-    std::set<std::string> pressedActions;
-    std::set<std::string> downThisFrameActions;
+    std::vector<std::string> actionNames;
+    // Action bound to each GLFW key code, noAction if none
+    std::array<ActionId, GLFW_KEY_LAST + 1> keyActions;
+    std::bitset<maxActions> pressedActions;
+    std::bitset<maxActions> downThisFrameActions;
+    std::bitset<maxActions> upThisFrameActions;
+    std::array<uint8_t, maxActions> pressCounts = {};
+    std::array<double, maxActions> transitionTimes = {};
+    double mouseX = 0.0;
+    double mouseY = 0.0;
+    // Movement since the last frame, raw when GLFW_RAW_MOUSE_MOTION is on
+    double mouseDeltaX = 0.0;
+    double mouseDeltaY = 0.0;
+    bool hasMousePosition = false;
+    double firstEventTime = -1.0;
+    // Callbacks only push, the simulation applies events in ProcessEvents
+    std::unique_ptr<InputEventQueue> events = std::make_unique<InputEventQueue>();
+    uint64_t droppedEvents = 0;
+    // Everything applied this frame, for recording
+    std::vector<InputEvent> frameEvents;
 
-protected:
-    void EndFrame(){
-        downThisFrameActions.clear();
+    void Push(const InputEvent &event)
+    {
+        if (!events->TryPush(event))
+        {
+            droppedEvents++;
+        }
     }
 
-    void OnKey(int key, int actionType)
+    void Apply(const InputEvent &event)
     {
-        if (mappings.find(key) == mappings.end())
+        frameEvents.push_back(event);
+        if (firstEventTime < 0.0)
+        {
+            firstEventTime = event.time;
+        }
+
+        if (event.type == InputEventType::MouseMove)
+        {
+            // The first position only sets the origin, it is no movement
+            if (hasMousePosition)
+            {
+                mouseDeltaX += event.x - mouseX;
+                mouseDeltaY += event.y - mouseY;
+            }
+            hasMousePosition = true;
+            mouseX = event.x;
+            mouseY = event.y;
+            return;
+        }
+
+        if (event.key < 0 || event.key > GLFW_KEY_LAST || keyActions[event.key] == noAction)
             return;
 
-        if (actionType == GLFW_PRESS)
+        const ActionId action = keyActions[event.key];
+        if (event.action == GLFW_PRESS)
         {
-            pressedActions.insert({mappings[key]});
-            downThisFrameActions.insert({mappings[key]});
+            pressedActions.set(action);
+            downThisFrameActions.set(action);
+            pressCounts[action] = static_cast<uint8_t>(std::min(pressCounts[action] + 1, 255));
+            transitionTimes[action] = event.time;
         }
-        else if (actionType == GLFW_RELEASE)
+        else if (event.action == GLFW_RELEASE)
         {
-            pressedActions.erase(mappings[key]);
+            pressedActions.reset(action);
+            upThisFrameActions.set(action);
+            transitionTimes[action] = event.time;
         }
     }
 
-    void OnMouseMove(float, float){
+protected:
+    void EndFrame(){
+        downThisFrameActions.reset();
+        upThisFrameActions.reset();
+        pressCounts.fill(0);
+        mouseDeltaX = 0.0;
+        mouseDeltaY = 0.0;
+        firstEventTime = -1.0;
+        frameEvents.clear();
+    }
+
+    // Called from the GLFW callbacks, timestamps are taken on arrival
+    void OnKey(int key, int actionType)
+    {
+        InputEvent event;
+        event.time = glfwGetTime();
+        event.type = InputEventType::Key;
+        event.key = key;
+        event.action = actionType;
+        Push(event);
+    }
 
+    void OnMouseMove(double x, double y)
+    {
+        InputEvent event;
+        event.time = glfwGetTime();
+        event.type = InputEventType::MouseMove;
+        event.x = x;
+        event.y = y;
+        Push(event);
     }
 
 public:
-    Input() {}
+    Input()
+    {
+        keyActions.fill(noAction);
+    }
 
-    Input(GLFWwindow *inWindow)
+    Input(GLFWwindow *inWindow, AssetReader &assetReader) : Input()
     {
 
         window = inWindow;
 
-        std::ifstream f("resources/config/input.json");
-        auto data = json::parse(f);
+        AssetView config = assetReader.Open("resources/config/input.json");
+        auto data = json::parse(config.Text());
         for (auto &[key, value] : data.items())
         {
-            mappings.insert({value.get<int>(), key});
+            const int keyCode = value.get<int>();
+            if (keyCode < 0 || keyCode > GLFW_KEY_LAST)
+            {
+                LogWarning("Input: invalid key {} for action {}", keyCode, key);
+                continue;
+            }
+
+            ActionId action = Action(key);
+            if (action == noAction)
+            {
+                if (actionNames.size() == maxActions)
+                {
+                    LogWarning("Input: more than {} actions, ignoring {}", maxActions, key);
+                    continue;
+                }
+                action = static_cast<ActionId>(actionNames.size());
+                actionNames.push_back(key);
+            }
+            keyActions[keyCode] = action;
+        }
+    }
+
+    // Id of a named action, noAction when input.json does not bind it. Meant
+    // to be called once at setup, not per query.
+    ActionId Action(std::string_view name) const
+    {
+        for (ActionId id = 0; id < actionNames.size(); ++id)
+        {
+            if (actionNames[id] == name)
+            {
+                return id;
+            }
+        }
+        return noAction;
+    }
+
+    std::string_view ActionName(ActionId action) const
+    {
+        return action < actionNames.size() ? std::string_view(actionNames[action]) : std::string_view();
+    }
+
+    bool IsDown(ActionId action) const
+    {
+        return action < maxActions && downThisFrameActions.test(action);
+    }
+
+    bool IsPressed(ActionId action) const
+    {
+        return action < maxActions && pressedActions.test(action);
+    }
+
+    bool IsReleased(ActionId action) const
+    {
+        return action < maxActions && upThisFrameActions.test(action);
+    }
+
+    // Presses since the last frame, a quick tap may be down and up already
+    uint32_t PressCount(ActionId action) const
+    {
+        return action < maxActions ? pressCounts[action] : 0;
+    }
+
+    // Time of the action's last press or release
+    double TransitionTime(ActionId action) const
+    {
+        return action < maxActions ? transitionTimes[action] : 0.0;
+    }
+
+    // Applies queued events up to the given time in order, later ones stay for
+    // the next call. A fixed-timestep loop calls this once per step with the
+    // step's end time.
+    void ProcessEvents(double until)
+    {
+        while (const InputEvent *event = events->Front())
+        {
+            if (event->time > until)
+            {
+                break;
+            }
+            Apply(*event);
+            events->Pop();
+        }
+    }
+
+    double MouseDeltaX() const
+    {
+        return mouseDeltaX;
+    }
+
+    double MouseDeltaY() const
+    {
+        return mouseDeltaY;
+    }
+
+    // Timestamp of the oldest event applied this frame, negative if none
+    double FirstEventTime() const
+    {
+        return firstEventTime;
+    }
+
+    // Applies an event that did not come from the window, e.g. a replay
+    void Inject(const InputEvent &event)
+    {
+        Apply(event);
+    }
+
+    // Throws away what the window queued, while a replay drives the input
+    void DiscardEvents()
+    {
+        while (events->Front())
+        {
+            events->Pop();
         }
     }
 
-    bool IsDown(std::string action){
-        return downThisFrameActions.find(action) != downThisFrameActions.end();
+    std::span<const InputEvent> FrameEvents() const
+    {
+        return frameEvents;
     }
 
-    bool IsPressed(std::string action){
-        return pressedActions.find(action) != pressedActions.end();
+    uint64_t DroppedEvents() const
+    {
+        return droppedEvents;
     }
-};
\ No newline at end of file
+};
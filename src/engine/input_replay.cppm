@@ -0,0 +1,224 @@
+export module input_replay;
+
+import <cstddef>;
+import <cstdint>;
+import <cstring>;
+import <filesystem>;
+import <fstream>;
+import <span>;
+import <vector>;
+
+import asset_io;
+import input;
+
+namespace fs = std::filesystem;
+
+// Input as the simulation consumed it, frame by frame:
+//
+//   magic, version
+//   per frame: double time, uint32 event count, events
+//
+// Events store their time as a float offset from the frame. Keys take 8
+// bytes (type, action, key, offset), mouse moves 24 (type, padding, offset,
+// double x and y).
+
+export constexpr uint32_t inputRecordingMagic = 0x504E4953; // "SINP"
+export constexpr uint32_t inputRecordingVersion = 1;
+
+struct KeyRecord
+{
+    uint8_t type;
+    uint8_t action;
+    int16_t key;
+    float offset;
+};
+
+struct MouseRecord
+{
+    uint8_t type;
+    uint8_t padding[3];
+    float offset;
+    double x;
+    double y;
+};
+
+static_assert(sizeof(KeyRecord) == 8);
+static_assert(sizeof(MouseRecord) == 24);
+
+template <typename T>
+void Append(std::vector<std::byte> &buffer, const T &value)
+{
+    const auto bytes = std::as_bytes(std::span(&value, 1));
+    buffer.insert(buffer.end(), bytes.begin(), bytes.end());
+}
+
+export class InputRecorder
+{
+public:
+    bool Open(const fs::path &path)
+    {
+        file.open(path, std::ios::binary | std::ios::trunc);
+        if (!file)
+        {
+            return false;
+        }
+        const uint32_t header[2] = {inputRecordingMagic, inputRecordingVersion};
+        file.write(reinterpret_cast<const char *>(header), sizeof(header));
+        return true;
+    }
+
+    bool IsOpen() const
+    {
+        return file.is_open();
+    }
+
+    void WriteFrame(double time, std::span<const InputEvent> events)
+    {
+        buffer.clear();
+        Append(buffer, time);
+        Append(buffer, static_cast<uint32_t>(events.size()));
+
+        for (const InputEvent &event : events)
+        {
+            const float offset = static_cast<float>(event.time - time);
+            if (event.type == InputEventType::Key)
+            {
+                Append(buffer, KeyRecord{static_cast<uint8_t>(event.type), static_cast<uint8_t>(event.action), static_cast<int16_t>(event.key), offset});
+            }
+            else
+            {
+                Append(buffer, MouseRecord{static_cast<uint8_t>(event.type), {}, offset, event.x, event.y});
+            }
+        }
+
+        file.write(reinterpret_cast<const char *>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+    }
+
+    void Close()
+    {
+        file.close();
+    }
+
+private:
+    std::ofstream file;
+    std::vector<std::byte> buffer;
+};
+
+// Plays a recording back in place of the window's events, one recorded frame
+// per pump, with the recorded frame times.
+export class InputReplay
+{
+public:
+    bool Open(const fs::path &path)
+    {
+        if (!file.Open(path))
+        {
+            return false;
+        }
+        file.Sequential();
+
+        uint32_t header[2] = {};
+        if (file.Bytes().size() < sizeof(header))
+        {
+            file.Close();
+            return false;
+        }
+        std::memcpy(header, file.Bytes().data(), sizeof(header));
+        if (header[0] != inputRecordingMagic || header[1] != inputRecordingVersion)
+        {
+            file.Close();
+            return false;
+        }
+
+        cursor = sizeof(header);
+        frame = 0;
+        return true;
+    }
+
+    bool IsOpen() const
+    {
+        return !file.Bytes().empty();
+    }
+
+    // Feeds the next frame's events to input and returns its time, false at
+    // the end of the recording or on a truncated one
+    bool NextFrame(Input &input, double &time)
+    {
+        uint32_t count = 0;
+        if (!Read(time) || !Read(count))
+        {
+            return false;
+        }
+
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            const std::span<const std::byte> bytes = file.Bytes();
+            if (cursor >= bytes.size())
+            {
+                return false;
+            }
+
+            InputEvent event;
+            event.type = static_cast<InputEventType>(bytes[cursor]);
+            if (event.type != InputEventType::Key && event.type != InputEventType::MouseMove)
+            {
+                return false;
+            }
+
+            if (event.type == InputEventType::Key)
+            {
+                KeyRecord record;
+                if (!Read(record))
+                {
+                    return false;
+                }
+                event.time = time + record.offset;
+                event.key = record.key;
+                event.action = record.action;
+            }
+            else
+            {
+                MouseRecord record;
+                if (!Read(record))
+                {
+                    return false;
+                }
+                event.time = time + record.offset;
+                event.x = record.x;
+                event.y = record.y;
+            }
+            input.Inject(event);
+        }
+
+        frame++;
+        return true;
+    }
+
+    uint64_t Frame() const
+    {
+        return frame;
+    }
+
+    void Close()
+    {
+        file.Close();
+    }
+
+private:
+    template <typename T>
+    bool Read(T &value)
+    {
+        const std::span<const std::byte> bytes = file.Bytes();
+        if (cursor + sizeof(T) > bytes.size())
+        {
+            return false;
+        }
+        std::memcpy(&value, bytes.data() + cursor, sizeof(T));
+        cursor += sizeof(T);
+        return true;
+    }
+
+    MappedFile file;
+    size_t cursor = 0;
+    uint64_t frame = 0;
+};
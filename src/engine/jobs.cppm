@@ -0,0 +1,189 @@
+export module jobs;
+
+import <algorithm>;
+import <atomic>;
+import <condition_variable>;
+import <cstdint>;
+import <deque>;
+import <functional>;
+import <mutex>;
+import <thread>;
+import <vector>;
+
+// Small worker pool for background work (asset parsing, mesh processing).
+// Threads waiting on a ParallelFor help run queued jobs, so it can be called
+// from inside a job without deadlocking.
+export class JobSystem
+{
+public:
+    JobSystem() : JobSystem(DefaultThreadCount()) {};
+
+    explicit JobSystem(uint32_t threadCount)
+    {
+        for (uint32_t i = 0; i < threadCount; ++i)
+        {
+            workers.emplace_back([this]()
+                                 { WorkerLoop(); });
+        }
+    }
+
+    JobSystem(const JobSystem &) = delete;
+    JobSystem &operator=(const JobSystem &) = delete;
+
+    ~JobSystem()
+    {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto &worker : workers)
+        {
+            worker.join();
+        }
+    }
+
+    // Runs inline when there are no workers (e.g. single threaded builds).
+    void Submit(std::function<void()> job)
+    {
+        if (workers.empty())
+        {
+            job();
+            return;
+        }
+
+        {
+            std::lock_guard lock(mutex);
+            queue.push_back(std::move(job));
+            active++;
+        }
+        wake.notify_one();
+    }
+
+    // Calls fn(begin, end) over [0, count) in chunks of at most grain items and
+    // returns once all of them ran.
+    template <typename F>
+    void ParallelFor(size_t count, size_t grain, F &&fn)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+
+        grain = std::max<size_t>(grain, 1);
+        const size_t chunks = (count + grain - 1) / grain;
+        if (chunks == 1 || workers.empty())
+        {
+            fn(size_t(0), count);
+            return;
+        }
+
+        std::atomic<size_t> remaining = chunks;
+        for (size_t chunk = 1; chunk < chunks; ++chunk)
+        {
+            Submit([&, chunk]()
+                   {
+                const size_t begin = chunk * grain;
+                fn(begin, std::min(begin + grain, count));
+                remaining.fetch_sub(1, std::memory_order_release); });
+        }
+
+        fn(size_t(0), std::min(grain, count));
+        remaining.fetch_sub(1, std::memory_order_release);
+
+        while (remaining.load(std::memory_order_acquire) > 0)
+        {
+            if (!RunOne())
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    void WaitIdle()
+    {
+        while (true)
+        {
+            {
+                std::lock_guard lock(mutex);
+                if (active == 0)
+                {
+                    return;
+                }
+            }
+            if (!RunOne())
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    uint32_t ThreadCount() const
+    {
+        return static_cast<uint32_t>(workers.size());
+    }
+
+    static uint32_t DefaultThreadCount()
+    {
+#ifdef __EMSCRIPTEN__
+        return 0;
+#else
+        const uint32_t hardware = std::thread::hardware_concurrency();
+        return hardware > 1 ? hardware - 1 : 1;
+#endif
+    }
+
+private:
+    bool RunOne()
+    {
+        std::function<void()> job;
+        {
+            std::lock_guard lock(mutex);
+            if (queue.empty())
+            {
+                return false;
+            }
+            job = std::move(queue.front());
+            queue.pop_front();
+        }
+
+        job();
+        Finish();
+        return true;
+    }
+
+    void Finish()
+    {
+        std::lock_guard lock(mutex);
+        active--;
+    }
+
+    void WorkerLoop()
+    {
+        while (true)
+        {
+            std::function<void()> job;
+            {
+                std::unique_lock lock(mutex);
+                wake.wait(lock, [this]()
+                          { return stopping || !queue.empty(); });
+                if (queue.empty())
+                {
+                    return;
+                }
+                job = std::move(queue.front());
+                queue.pop_front();
+            }
+
+            job();
+            Finish();
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> queue;
+    std::mutex mutex;
+    std::condition_variable wake;
+    size_t active = 0;
+    bool stopping = false;
+};
@@ -0,0 +1,71 @@
+export module latency;
+
+import <algorithm>;
+import <cstdint>;
+import <ostream>;
+import <vector>;
+
+// Input-to-photon estimate for frames that applied input: from the timestamp
+// of the oldest event the frame consumed to its submit and to the return of
+// present. Present returning means the image was queued, the compositor and
+// scanout still add up to a refresh on top.
+export class LatencyStats
+{
+public:
+    // inputTime is negative for frames without input, which are skipped
+    void Record(double inputTime, double submitTime, double presentTime)
+    {
+        if (inputTime < 0.0)
+        {
+            return;
+        }
+
+        const Sample sample = {static_cast<float>((submitTime - inputTime) * 1000.0), static_cast<float>((presentTime - inputTime) * 1000.0)};
+        if (samples.size() < maxSamples)
+        {
+            samples.push_back(sample);
+        }
+        else
+        {
+            samples[count % maxSamples] = sample;
+        }
+        count++;
+    }
+
+    void PrintStats(std::ostream &out) const
+    {
+        if (samples.empty())
+        {
+            return;
+        }
+
+        std::vector<float> submit;
+        std::vector<float> present;
+        for (const Sample &sample : samples)
+        {
+            submit.push_back(sample.submit);
+            present.push_back(sample.present);
+        }
+        std::sort(submit.begin(), submit.end());
+        std::sort(present.begin(), present.end());
+
+        const auto percentile = [](const std::vector<float> &sorted, float p)
+        { return sorted[static_cast<size_t>(p * static_cast<float>(sorted.size() - 1))]; };
+
+        out << "Input latency over " << count << " frames: submit p50 " << percentile(submit, 0.5f) << " ms, p95 " << percentile(submit, 0.95f)
+            << " ms; present p50 " << percentile(present, 0.5f) << " ms, p95 " << percentile(present, 0.95f) << " ms, max " << present.back()
+            << " ms" << std::endl;
+    }
+
+private:
+    struct Sample
+    {
+        float submit;
+        float present;
+    };
+
+    // The most recent frames, older ones are overwritten
+    static constexpr size_t maxSamples = 4096;
+    std::vector<Sample> samples;
+    uint64_t count = 0;
+};
@@ -11,10 +11,52 @@ export module loader;
 export import <glm/glm.hpp>;
 export import <glm/ext.hpp>;
 
+import <algorithm>;
+import <cstring>;
 import <iostream>;
 import <filesystem>;
+import <memory>;
+import <span>;
+import <string_view>;
+import <unordered_map>;
+
+import archive;
+import asset_io;
+import compression;
+import jobs;
+import logging;
 
 namespace fs = std::filesystem;
+
+// Resolves .mtl files through the asset reader so they can come from the archive
+class AssetMaterialReader : public tinyobj::MaterialReader
+{
+public:
+    AssetMaterialReader(AssetReader &inAssetReader, const fs::path &inBaseDir) : assetReader(inAssetReader), baseDir(inBaseDir) {};
+
+    bool operator()(const std::string &matId, std::vector<tinyobj::material_t> *materials,
+                    std::map<std::string, int> *matMap, std::string *warn, std::string *err) override
+    {
+        AssetView asset = assetReader.Open(baseDir / matId);
+        if (!asset)
+        {
+            if (warn)
+            {
+                *warn += "Material file [ " + matId + " ] not found.\n";
+            }
+            return false;
+        }
+
+        SpanStreamBuf buffer(asset.bytes);
+        std::istream stream(&buffer);
+        tinyobj::LoadMtl(matMap, materials, &stream, warn, err);
+        return true;
+    }
+
+private:
+    AssetReader &assetReader;
+    fs::path baseDir;
+};
 export using glm::mat4x4;
 export using glm::vec2;
 export using glm::vec3;
@@ -23,15 +65,134 @@ export using glm::vec4;
 export namespace Loader
 {
 
+    // Attributes a mesh really carries, the others hold the defaults below
+    enum VertexStreams : uint32_t
+    {
+        StreamNormal = 1u << 0,
+        StreamColor = 1u << 1,
+        StreamUv = 1u << 2,
+        StreamTangent = 1u << 3,
+    };
+
     struct VertexAttributes
     {
-        vec3 position;
-        vec3 normal;
-        vec3 color;
-        vec2 uv;
+        vec3 position = vec3(0.0f);
+        vec3 normal = vec3(0.0f, 0.0f, 1.0f);
+        vec3 color = vec3(1.0f);
+        vec2 uv = vec2(0.0f);
+        // MikkTSpace convention: bitangent = w * cross(normal, tangent.xyz)
+        vec4 tangent = vec4(1.0f, 0.0f, 0.0f, 1.0f);
+    };
+
+    // Cluster of at most a few dozen triangles, contiguous in the index buffer
+    struct Meshlet
+    {
+        vec4 sphere;
+        // Axis and sine of the cone half angle, a cutoff of 1 disables cone culling
+        vec4 cone;
+        uint32_t firstIndex = 0;
+        uint32_t indexCount = 0;
+        uint32_t vertexCount = 0;
+        uint32_t padding = 0;
+    };
+
+    // One level of detail: a range of the shared index buffer and of the
+    // meshlets, error is how far (object space) it strays from the full mesh
+    struct MeshLod
+    {
+        vec4 sphere;
+        uint32_t firstIndex = 0;
+        uint32_t indexCount = 0;
+        uint32_t firstMeshlet = 0;
+        uint32_t meshletCount = 0;
+        float error = 0.0f;
+        uint32_t padding[3] = {};
     };
 
-    bool LoadGeometryFromObj(const fs::path &path, std::vector<VertexAttributes> &vertexData)
+    // Indexed mesh, vertices shared between the triangles that use them. When
+    // meshlets are built the indices are ordered meshlet by meshlet, LODs
+    // (if any) follow each other in the index buffer, finest first.
+    struct Mesh
+    {
+        std::vector<VertexAttributes> vertices;
+        std::vector<uint32_t> indices;
+        std::vector<Meshlet> meshlets;
+        std::vector<MeshLod> lods;
+        uint32_t streams = 0;
+    };
+}
+
+namespace Loader
+{
+    // tinyobj gathers its messages in one string, a record per line keeps
+    // them within the log payload
+    void LogObjMessages(std::string_view text, bool error)
+    {
+        while (!text.empty())
+        {
+            const size_t end = std::min(text.find('\n'), text.size());
+            const std::string_view line = text.substr(0, end);
+            if (!line.empty() && error)
+            {
+                LogError("OBJ: {}", line);
+            }
+            else if (!line.empty())
+            {
+                LogWarning("OBJ: {}", line);
+            }
+            text.remove_prefix(std::min(end + 1, text.size()));
+        }
+    }
+
+    // Reads one OBJ corner and returns the streams it has, indices the file
+    // does not back (no vn/vt, no vertex colors) leave the defaults alone.
+    uint32_t ReadObjVertex(const tinyobj::attrib_t &attrib, const tinyobj::index_t &idx, VertexAttributes &vertex)
+    {
+        uint32_t streams = 0;
+        const size_t v = static_cast<size_t>(idx.vertex_index);
+
+        vertex.position = {
+            attrib.vertices[3 * v + 0],
+            attrib.vertices[3 * v + 1],
+            attrib.vertices[3 * v + 2]};
+
+        if (idx.normal_index >= 0 && 3 * size_t(idx.normal_index) + 2 < attrib.normals.size())
+        {
+            const size_t n = static_cast<size_t>(idx.normal_index);
+            vertex.normal = {
+                attrib.normals[3 * n + 0],
+                attrib.normals[3 * n + 1],
+                attrib.normals[3 * n + 2]};
+            streams |= StreamNormal;
+        }
+
+        if (3 * v + 2 < attrib.colors.size())
+        {
+            vertex.color = {
+                attrib.colors[3 * v + 0],
+                attrib.colors[3 * v + 1],
+                attrib.colors[3 * v + 2]};
+            streams |= StreamColor;
+        }
+
+        if (idx.texcoord_index >= 0 && 2 * size_t(idx.texcoord_index) + 1 < attrib.texcoords.size())
+        {
+            const size_t t = static_cast<size_t>(idx.texcoord_index);
+            vertex.uv = {
+                attrib.texcoords[2 * t + 0],
+                1 - attrib.texcoords[2 * t + 1]};
+            streams |= StreamUv;
+        }
+
+        return streams;
+    }
+}
+
+export namespace Loader
+{
+    // Parses OBJ text in place, materials are looked up next to baseDir through
+    // the asset reader when given, on disk otherwise.
+    bool LoadMeshFromObj(std::span<const std::byte> bytes, const fs::path &baseDir, Mesh &mesh, AssetReader *assetReader = nullptr)
     {
         tinyobj::attrib_t attrib;
         std::vector<tinyobj::shape_t> shapes;
@@ -40,57 +201,233 @@ export namespace Loader
         std::string warn;
         std::string err;
 
-        // Call the core loading procedure of TinyOBJLoader
-        bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, path.string().c_str());
-
-        // Check errors
-        if (!warn.empty())
+        SpanStreamBuf buffer(bytes);
+        std::istream stream(&buffer);
+        std::string materialDir = baseDir.empty() ? std::string() : (baseDir / "").string();
+        tinyobj::MaterialFileReader fileMaterialReader(materialDir);
+        std::unique_ptr<AssetMaterialReader> assetMaterialReader;
+        tinyobj::MaterialReader *materialReader = &fileMaterialReader;
+        if (assetReader)
         {
-            std::cout << warn << std::endl;
+            assetMaterialReader = std::make_unique<AssetMaterialReader>(*assetReader, baseDir);
+            materialReader = assetMaterialReader.get();
         }
 
-        if (!err.empty())
-        {
-            std::cerr << err << std::endl;
-        }
+        // No made up white vertex colors, a missing stream is recorded as such
+        bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, &stream, materialReader, true, false);
+
+        LogObjMessages(warn, false);
+        LogObjMessages(err, true);
 
         if (!ret)
         {
             return false;
         }
 
-        // Filling in vertexData:
-        vertexData.clear();
+        struct IndexHash
+        {
+            size_t operator()(const tinyobj::index_t &idx) const
+            {
+                return (static_cast<size_t>(idx.vertex_index) * 73856093) ^ (static_cast<size_t>(idx.normal_index) * 19349663) ^ (static_cast<size_t>(idx.texcoord_index) * 83492791);
+            }
+        };
+        struct IndexEqual
+        {
+            bool operator()(const tinyobj::index_t &a, const tinyobj::index_t &b) const
+            {
+                return a.vertex_index == b.vertex_index && a.normal_index == b.normal_index && a.texcoord_index == b.texcoord_index;
+            }
+        };
+
+        // OBJ corners referencing the same attributes become one vertex
+        std::unordered_map<tinyobj::index_t, uint32_t, IndexHash, IndexEqual> remap;
+
+        mesh.vertices.clear();
+        mesh.indices.clear();
+        // A stream counts only when every corner has it, generators fill in the rest
+        uint32_t streams = StreamNormal | StreamColor | StreamUv;
         for (const auto &shape : shapes)
         {
-            size_t offset = vertexData.size();
-            vertexData.resize(offset + shape.mesh.indices.size());
+            mesh.indices.reserve(mesh.indices.size() + shape.mesh.indices.size());
 
-            for (size_t i = 0; i < shape.mesh.indices.size(); ++i)
+            for (const tinyobj::index_t &idx : shape.mesh.indices)
             {
-                const tinyobj::index_t &idx = shape.mesh.indices[i];
-
-                vertexData[offset + i].position = {
-                    attrib.vertices[3 * idx.vertex_index + 0],
-                    attrib.vertices[3 * idx.vertex_index + 1],
-                    attrib.vertices[3 * idx.vertex_index + 2]};
-
-                vertexData[offset + i].normal = {
-                    attrib.normals[3 * idx.normal_index + 0],
-                    attrib.normals[3 * idx.normal_index + 1],
-                    attrib.normals[3 * idx.normal_index + 2]};
-
-                vertexData[offset + i].color = {
-                    attrib.colors[3 * idx.vertex_index + 0],
-                    attrib.colors[3 * idx.vertex_index + 1],
-                    attrib.colors[3 * idx.vertex_index + 2]};
-
-                vertexData[offset + i].uv = {
-                    attrib.texcoords[2 * idx.texcoord_index + 0],
-                    1 - attrib.texcoords[2 * idx.texcoord_index + 1]};
+                auto [it, inserted] = remap.try_emplace(idx, static_cast<uint32_t>(mesh.vertices.size()));
+                if (inserted)
+                {
+                    VertexAttributes vertex;
+                    streams &= ReadObjVertex(attrib, idx, vertex);
+                    mesh.vertices.push_back(vertex);
+                }
+                mesh.indices.push_back(it->second);
             }
         }
+        mesh.streams = mesh.vertices.empty() ? 0 : streams;
+
+        return true;
+    }
+
+    bool LoadMeshFromObj(const fs::path &path, Mesh &mesh)
+    {
+        MappedFile file;
+        if (!file.Open(path))
+        {
+            LogError("Cannot open file [{}]", path.string());
+            return false;
+        }
+        file.Sequential();
+        return LoadMeshFromObj(file.Bytes(), path.parent_path(), mesh);
+    }
+
+    constexpr uint32_t meshBlobMagic = 0x48534D53; // "SMSH"
+    constexpr uint32_t meshBlobVersion = 4;
+
+    // Binary mesh as produced at pack time: the header followed by the vertex
+    // and the index stream, each raw or a chunked container, then the raw
+    // meshlet and LOD tables. streams tells which vertex attributes are real.
+    struct MeshBlobHeader
+    {
+        uint32_t magic = meshBlobMagic;
+        uint32_t version = meshBlobVersion;
+        uint32_t vertexCount = 0;
+        uint32_t indexCount = 0;
+        uint32_t vertexStride = sizeof(VertexAttributes);
+        Compression compression = Compression::None;
+        uint64_t vertexStreamSize = 0;
+        uint64_t indexStreamSize = 0;
+        uint64_t meshletStreamSize = 0;
+        uint32_t meshletCount = 0;
+        uint32_t lodCount = 0;
+        uint64_t lodStreamSize = 0;
+        uint32_t streams = 0;
+        uint32_t reserved = 0;
+    };
+
+    static_assert(sizeof(MeshBlobHeader) == 72);
+
+    struct MeshBlob
+    {
+        MeshBlobHeader header;
+        std::span<const std::byte> vertexStream;
+        std::span<const std::byte> indexStream;
+        std::span<const std::byte> meshletStream;
+        std::span<const std::byte> lodStream;
+    };
+
+    std::vector<std::byte> WriteMeshBlob(const Mesh &mesh, Compression compression = Compression::None, uint32_t chunkSize = defaultCompressionChunkSize)
+    {
+        const std::span<const std::byte> vertices = std::as_bytes(std::span(mesh.vertices));
+        const std::span<const std::byte> indices = std::as_bytes(std::span(mesh.indices));
+        const std::span<const std::byte> meshlets = std::as_bytes(std::span(mesh.meshlets));
+        const std::span<const std::byte> lods = std::as_bytes(std::span(mesh.lods));
+
+        std::vector<std::byte> vertexStream;
+        std::vector<std::byte> indexStream;
+        if (compression == Compression::None)
+        {
+            vertexStream.assign(vertices.begin(), vertices.end());
+            indexStream.assign(indices.begin(), indices.end());
+        }
+        else
+        {
+            vertexStream = CompressChunked(vertices, compression, chunkSize);
+            indexStream = CompressChunked(indices, compression, chunkSize);
+        }
+
+        MeshBlobHeader header;
+        header.vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+        header.indexCount = static_cast<uint32_t>(mesh.indices.size());
+        header.compression = compression;
+        header.vertexStreamSize = vertexStream.size();
+        header.indexStreamSize = indexStream.size();
+        header.meshletCount = static_cast<uint32_t>(mesh.meshlets.size());
+        header.meshletStreamSize = meshlets.size();
+        header.lodCount = static_cast<uint32_t>(mesh.lods.size());
+        header.lodStreamSize = lods.size();
+        header.streams = mesh.streams;
+
+        std::vector<std::byte> blob(sizeof(header) + vertexStream.size() + indexStream.size() + meshlets.size() + lods.size());
+        auto out = blob.begin();
+        out = std::copy_n(reinterpret_cast<const std::byte *>(&header), sizeof(header), out);
+        out = std::copy(vertexStream.begin(), vertexStream.end(), out);
+        out = std::copy(indexStream.begin(), indexStream.end(), out);
+        out = std::copy(meshlets.begin(), meshlets.end(), out);
+        std::copy(lods.begin(), lods.end(), out);
+        return blob;
+    }
+
+    bool ParseMeshBlob(std::span<const std::byte> bytes, MeshBlob &blob)
+    {
+        if (bytes.size() < sizeof(MeshBlobHeader))
+        {
+            return false;
+        }
+        std::memcpy(&blob.header, bytes.data(), sizeof(MeshBlobHeader));
 
+        const MeshBlobHeader &header = blob.header;
+        if (header.magic != meshBlobMagic || header.version != meshBlobVersion || header.vertexStride != sizeof(VertexAttributes) ||
+            header.meshletStreamSize != uint64_t(header.meshletCount) * sizeof(Meshlet) ||
+            header.lodStreamSize != uint64_t(header.lodCount) * sizeof(MeshLod) ||
+            sizeof(MeshBlobHeader) + header.vertexStreamSize + header.indexStreamSize + header.meshletStreamSize + header.lodStreamSize > bytes.size())
+        {
+            return false;
+        }
+
+        uint64_t offset = sizeof(MeshBlobHeader);
+        blob.vertexStream = bytes.subspan(offset, header.vertexStreamSize);
+        offset += header.vertexStreamSize;
+        blob.indexStream = bytes.subspan(offset, header.indexStreamSize);
+        offset += header.indexStreamSize;
+        blob.meshletStream = bytes.subspan(offset, header.meshletStreamSize);
+        offset += header.meshletStreamSize;
+        blob.lodStream = bytes.subspan(offset, header.lodStreamSize);
         return true;
     }
+
+    void ReadMeshTables(const MeshBlob &blob, std::vector<Meshlet> &meshlets, std::vector<MeshLod> &lods)
+    {
+        meshlets.resize(blob.header.meshletCount);
+        if (!meshlets.empty())
+        {
+            std::memcpy(meshlets.data(), blob.meshletStream.data(), blob.meshletStream.size());
+        }
+        lods.resize(blob.header.lodCount);
+        if (!lods.empty())
+        {
+            std::memcpy(lods.data(), blob.lodStream.data(), blob.lodStream.size());
+        }
+    }
+
+    // Decompresses a binary mesh into CPU memory, chunks in parallel.
+    bool LoadMeshFromBlob(std::span<const std::byte> bytes, Mesh &mesh, JobSystem &jobs)
+    {
+        MeshBlob blob;
+        if (!ParseMeshBlob(bytes, blob))
+        {
+            return false;
+        }
+
+        ReadMeshTables(blob, mesh.meshlets, mesh.lods);
+        mesh.streams = blob.header.streams;
+        mesh.vertices.resize(blob.header.vertexCount);
+        mesh.indices.resize(blob.header.indexCount);
+        const std::span<std::byte> vertices = std::as_writable_bytes(std::span(mesh.vertices));
+        const std::span<std::byte> indices = std::as_writable_bytes(std::span(mesh.indices));
+
+        if (blob.header.compression == Compression::None)
+        {
+            if (blob.vertexStream.size() != vertices.size() || blob.indexStream.size() != indices.size())
+            {
+                return false;
+            }
+            std::memcpy(vertices.data(), blob.vertexStream.data(), vertices.size());
+            std::memcpy(indices.data(), blob.indexStream.data(), indices.size());
+            return true;
+        }
+
+        ChunkedBlob vertexChunks;
+        ChunkedBlob indexChunks;
+        return vertexChunks.Parse(blob.vertexStream) && indexChunks.Parse(blob.indexStream) &&
+               vertexChunks.Decompress(jobs, vertices) && indexChunks.Decompress(jobs, indices);
+    }
 };
\ No newline at end of file
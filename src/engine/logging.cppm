@@ -0,0 +1,444 @@
+export module logging;
+
+import <algorithm>;
+import <atomic>;
+import <chrono>;
+import <condition_variable>;
+import <cstdint>;
+import <cstring>;
+import <iostream>;
+import <memory>;
+import <mutex>;
+import <sstream>;
+import <string>;
+import <string_view>;
+import <thread>;
+import <type_traits>;
+import <vector>;
+
+import spsc_ring;
+
+#ifndef SHADY_LOG_LEVEL
+#define SHADY_LOG_LEVEL 1
+#endif
+
+export enum class LogLevel : uint8_t
+{
+    Trace,
+    Debug,
+    Info,
+    Warning,
+    Error,
+};
+
+// Calls below this level compile to nothing
+export constexpr LogLevel minLogLevel = static_cast<LogLevel>(SHADY_LOG_LEVEL);
+
+constexpr size_t maxLogArguments = 6;
+constexpr size_t logPayloadSize = 96;
+
+enum class LogArgument : uint8_t
+{
+    Int,
+    UInt,
+    Float,
+    Pointer,
+    String,
+};
+
+// One message as the calling thread leaves it: the format string (a literal,
+// only its pointer is kept) and the arguments in binary. Formatting happens on
+// the writer thread.
+struct LogRecord
+{
+    uint64_t time;
+    const char *format;
+    LogLevel level;
+    uint8_t argumentCount;
+    uint8_t truncated;
+    LogArgument arguments[maxLogArguments];
+    uint8_t padding[5];
+    std::byte payload[logPayloadSize];
+};
+
+static_assert(sizeof(LogRecord) == 128);
+
+using LogQueue = SpscRing<LogRecord, 512>;
+
+class LogEncoder
+{
+public:
+    explicit LogEncoder(LogRecord &inRecord) : record(inRecord) {}
+
+    template <typename T>
+    void Add(const T &value)
+    {
+        using D = std::decay_t<T>;
+        if (record.argumentCount == maxLogArguments)
+        {
+            record.truncated = 1;
+        }
+        else if constexpr (std::is_same_v<D, bool>)
+        {
+            AddString(value ? "true" : "false");
+        }
+        else if constexpr (std::is_same_v<D, char>)
+        {
+            AddString(std::string_view(&value, 1));
+        }
+        else if constexpr (std::is_same_v<T, const char *> || std::is_same_v<T, char *>)
+        {
+            AddString(value ? std::string_view(value) : std::string_view("(null)"));
+        }
+        else if constexpr (std::is_enum_v<D>)
+        {
+            Add(static_cast<std::underlying_type_t<D>>(value));
+        }
+        else if constexpr (std::is_integral_v<D> && std::is_signed_v<D>)
+        {
+            AddScalar(LogArgument::Int, static_cast<int64_t>(value));
+        }
+        else if constexpr (std::is_integral_v<D>)
+        {
+            AddScalar(LogArgument::UInt, static_cast<uint64_t>(value));
+        }
+        else if constexpr (std::is_floating_point_v<D>)
+        {
+            AddScalar(LogArgument::Float, static_cast<double>(value));
+        }
+        else if constexpr (std::is_convertible_v<const D &, std::string_view>)
+        {
+            AddString(std::string_view(value));
+        }
+        else if constexpr (std::is_pointer_v<D>)
+        {
+            AddScalar(LogArgument::Pointer, reinterpret_cast<uintptr_t>(value));
+        }
+        else
+        {
+            // Anything else is formatted right away, keep these off hot paths
+            std::ostringstream stream;
+            stream << value;
+            AddString(stream.view());
+        }
+    }
+
+private:
+    template <typename T>
+    void AddScalar(LogArgument type, T value)
+    {
+        if (offset + sizeof(T) > logPayloadSize)
+        {
+            record.truncated = 1;
+            return;
+        }
+        std::memcpy(record.payload + offset, &value, sizeof(T));
+        offset += sizeof(T);
+        record.arguments[record.argumentCount++] = type;
+    }
+
+    // Length prefixed, cut to what is left of the payload
+    void AddString(std::string_view text)
+    {
+        if (offset + sizeof(uint16_t) > logPayloadSize)
+        {
+            record.truncated = 1;
+            return;
+        }
+        const uint16_t length = static_cast<uint16_t>(std::min(text.size(), logPayloadSize - offset - sizeof(uint16_t)));
+        record.truncated |= length < text.size();
+        std::memcpy(record.payload + offset, &length, sizeof(length));
+        std::memcpy(record.payload + offset + sizeof(length), text.data(), length);
+        offset += sizeof(length) + length;
+        record.arguments[record.argumentCount++] = LogArgument::String;
+    }
+
+    LogRecord &record;
+    size_t offset = 0;
+};
+
+// Asynchronous logger. Every thread writes into its own lock-free ring, a
+// background thread formats and writes the records in time order. A full ring
+// drops messages (counted) rather than stalling the caller. Single threaded
+// builds (web) format and write immediately.
+export class Logger
+{
+public:
+    static Logger &Instance()
+    {
+        static Logger logger;
+        return logger;
+    }
+
+    Logger(const Logger &) = delete;
+    Logger &operator=(const Logger &) = delete;
+
+    ~Logger()
+    {
+#ifndef __EMSCRIPTEN__
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        writer.join();
+#endif
+    }
+
+    template <typename... Args>
+    void Write(LogLevel level, const char *format, const Args &...args)
+    {
+        LogRecord record;
+        record.time = static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+        record.format = format;
+        record.level = level;
+        record.argumentCount = 0;
+        record.truncated = 0;
+
+        LogEncoder encoder(record);
+        (encoder.Add(args), ...);
+
+#ifdef __EMSCRIPTEN__
+        std::string line;
+        Format(record, line);
+        Output(level) << line << '\n';
+#else
+        if (!ThreadQueue().TryPush(record))
+        {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (level >= LogLevel::Warning)
+        {
+            wake.notify_one();
+        }
+#endif
+    }
+
+    // Blocks until every record pushed before the call was written
+    void Flush()
+    {
+#ifndef __EMSCRIPTEN__
+        std::unique_lock lock(mutex);
+        const uint64_t target = ++flushRequests;
+        wake.notify_one();
+        flushed.wait(lock, [&]()
+                     { return flushesDone >= target || stopping; });
+#endif
+    }
+
+    // Messages lost to full rings so far
+    uint64_t Dropped() const
+    {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
+private:
+    Logger()
+    {
+#ifndef __EMSCRIPTEN__
+        writer = std::thread([this]()
+                             { WriterLoop(); });
+#endif
+    }
+
+    static std::ostream &Output(LogLevel level)
+    {
+        return level >= LogLevel::Warning ? std::cerr : std::cout;
+    }
+
+    LogQueue &ThreadQueue()
+    {
+        // Rings belong to the logger so messages survive their thread
+        thread_local LogQueue *queue = nullptr;
+        if (!queue)
+        {
+            auto owned = std::make_unique<LogQueue>();
+            queue = owned.get();
+            std::lock_guard lock(mutex);
+            queues.push_back(std::move(owned));
+        }
+        return *queue;
+    }
+
+    void WriterLoop()
+    {
+        std::vector<LogRecord> batch;
+        std::string line;
+
+        std::unique_lock lock(mutex);
+        while (true)
+        {
+            wake.wait_for(lock, std::chrono::milliseconds(5), [this]()
+                          { return stopping || flushRequests > flushesDone; });
+            const bool stop = stopping;
+            const uint64_t flushTarget = flushRequests;
+
+            // The rings can be drained without the lock, only the list needs it
+            std::vector<LogQueue *> snapshot;
+            for (const auto &queue : queues)
+            {
+                snapshot.push_back(queue.get());
+            }
+            lock.unlock();
+
+            batch.clear();
+            for (LogQueue *queue : snapshot)
+            {
+                LogRecord record;
+                while (queue->TryPop(record))
+                {
+                    batch.push_back(record);
+                }
+            }
+            std::stable_sort(batch.begin(), batch.end(), [](const LogRecord &a, const LogRecord &b)
+                             { return a.time < b.time; });
+
+            for (const LogRecord &record : batch)
+            {
+                Format(record, line);
+                Output(record.level) << line << '\n';
+            }
+
+            const uint64_t lost = dropped.load(std::memory_order_relaxed);
+            if (lost > reportedDrops)
+            {
+                std::cerr << "Logger: dropped " << lost - reportedDrops << " messages" << std::endl;
+                reportedDrops = lost;
+            }
+            if (!batch.empty())
+            {
+                std::cout.flush();
+            }
+
+            lock.lock();
+            flushesDone = flushTarget;
+            flushed.notify_all();
+            if (stop)
+            {
+                return;
+            }
+        }
+    }
+
+    // Replaces every {} of the format with the next argument in turn
+    static void Format(const LogRecord &record, std::string &line)
+    {
+        line.clear();
+        size_t offset = 0;
+        uint8_t argument = 0;
+
+        for (const char *c = record.format; *c; ++c)
+        {
+            if (c[0] != '{' || c[1] != '}')
+            {
+                line.push_back(*c);
+                continue;
+            }
+            ++c;
+
+            if (argument == record.argumentCount)
+            {
+                line += "{?}";
+                continue;
+            }
+
+            const std::byte *data = record.payload + offset;
+            switch (record.arguments[argument++])
+            {
+            case LogArgument::Int:
+            {
+                int64_t value;
+                std::memcpy(&value, data, sizeof(value));
+                line += std::to_string(value);
+                offset += sizeof(value);
+                break;
+            }
+            case LogArgument::UInt:
+            {
+                uint64_t value;
+                std::memcpy(&value, data, sizeof(value));
+                line += std::to_string(value);
+                offset += sizeof(value);
+                break;
+            }
+            case LogArgument::Float:
+            {
+                double value;
+                std::memcpy(&value, data, sizeof(value));
+                std::ostringstream stream;
+                stream << value;
+                line += stream.view();
+                offset += sizeof(value);
+                break;
+            }
+            case LogArgument::Pointer:
+            {
+                uintptr_t value;
+                std::memcpy(&value, data, sizeof(value));
+                std::ostringstream stream;
+                stream << reinterpret_cast<const void *>(value);
+                line += stream.view();
+                offset += sizeof(value);
+                break;
+            }
+            case LogArgument::String:
+            {
+                uint16_t length;
+                std::memcpy(&length, data, sizeof(length));
+                line.append(reinterpret_cast<const char *>(data + sizeof(length)), length);
+                offset += sizeof(length) + length;
+                break;
+            }
+            }
+        }
+
+        if (record.truncated)
+        {
+            line += " [truncated]";
+        }
+    }
+
+    std::vector<std::unique_ptr<LogQueue>> queues;
+    std::atomic<uint64_t> dropped = 0;
+    uint64_t reportedDrops = 0;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable flushed;
+    uint64_t flushRequests = 0;
+    uint64_t flushesDone = 0;
+    bool stopping = false;
+    std::thread writer;
+};
+
+export template <LogLevel level, typename... Args>
+void Log(const char *format, const Args &...args)
+{
+    if constexpr (level >= minLogLevel)
+    {
+        Logger::Instance().Write(level, format, args...);
+    }
+}
+
+export template <typename... Args>
+void LogDebug(const char *format, const Args &...args)
+{
+    Log<LogLevel::Debug>(format, args...);
+}
+
+export template <typename... Args>
+void LogInfo(const char *format, const Args &...args)
+{
+    Log<LogLevel::Info>(format, args...);
+}
+
+export template <typename... Args>
+void LogWarning(const char *format, const Args &...args)
+{
+    Log<LogLevel::Warning>(format, args...);
+}
+
+export template <typename... Args>
+void LogError(const char *format, const Args &...args)
+{
+    Log<LogLevel::Error>(format, args...);
+}
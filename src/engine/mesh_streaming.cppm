@@ -0,0 +1,337 @@
+module;
+
+#include <webgpu/webgpu.hpp>
+
+export module mesh_streaming;
+
+import <algorithm>;
+import <atomic>;
+import <cstdint>;
+import <cstring>;
+import <filesystem>;
+import <memory>;
+import <span>;
+import <vector>;
+
+import archive;
+import asset_io;
+import attributes;
+import compression;
+import buffer_pool;
+import jobs;
+import loader;
+import logging;
+import meshlets;
+import staging_belt;
+
+namespace fs = std::filesystem;
+using namespace wgpu;
+
+export using MeshId = uint32_t;
+
+export enum class MeshState
+{
+    Queued,
+    Parsing,
+    Parsed,
+    Uploading,
+    Resident,
+    Failed
+};
+
+export struct MeshDrawInfo
+{
+    Buffer vertexBuffer = nullptr;
+    uint64_t vertexOffset = 0;
+    uint64_t vertexSize = 0;
+    Buffer indexBuffer = nullptr;
+    uint64_t indexOffset = 0;
+    uint64_t indexSize = 0;
+    uint32_t indexCount = 0;
+    // Index ranges with bounds for culling, empty if the mesh has none
+    std::span<const Loader::Meshlet> meshlets;
+    // Levels of detail indexing the same buffers, empty if the mesh has none
+    std::span<const Loader::MeshLod> lods;
+};
+
+// Bytes of one GPU buffer's worth of mesh data, either plain memory or a
+// chunked container decompressed straight into staging memory.
+struct StreamSource
+{
+    std::span<const std::byte> raw;
+    ChunkedBlob chunked;
+    bool compressed = false;
+
+    uint64_t Size() const
+    {
+        return compressed ? chunked.RawSize() : raw.size();
+    }
+};
+
+struct StreamedMesh
+{
+    fs::path path;
+    std::atomic<MeshState> state = MeshState::Queued;
+    Loader::Mesh data;
+    std::vector<Loader::Meshlet> meshlets;
+    std::vector<Loader::MeshLod> lods;
+    AssetView asset;
+    StreamSource vertexSource;
+    StreamSource indexSource;
+    BufferRange vertexRange;
+    BufferRange indexRange;
+    uint64_t vertexBytesStaged = 0;
+    uint64_t indexBytesStaged = 0;
+    uint32_t indexCount = 0;
+    std::atomic<uint32_t> pendingCopies = 0;
+};
+
+// Loads meshes without blocking the frame loop: requests return an id right
+// away, OBJ parsing runs on the job system and the GPU upload is spread over
+// frames through the staging belt under a per-frame byte budget.
+export class MeshStreamer
+{
+public:
+    static constexpr uint64_t defaultUploadBudget = 4ull << 20;
+
+    MeshStreamer(JobSystem &inJobs, AssetReader &inAssetReader, BufferPool &inBufferPool, StagingBelt &inStagingBelt)
+        : jobs(inJobs), assetReader(inAssetReader), bufferPool(inBufferPool), stagingBelt(inStagingBelt) {};
+
+    MeshStreamer(const MeshStreamer &) = delete;
+    MeshStreamer &operator=(const MeshStreamer &) = delete;
+
+    // Prefers the binary mesh packed next to the OBJ (same name, .mesh), whose
+    // streams are decompressed during the upload instead of parsed.
+    MeshId Request(const fs::path &path)
+    {
+        auto mesh = std::make_unique<StreamedMesh>();
+        mesh->path = path;
+        StreamedMesh *target = mesh.get();
+        meshes.push_back(std::move(mesh));
+
+        // Pages start coming in while the job waits in the queue
+        AssetView binary = assetReader.Queue(fs::path(path).replace_extension(".mesh"));
+        if (!binary)
+        {
+            assetReader.Queue(path);
+        }
+
+        jobs.Submit([this, target, binary]()
+                    {
+            target->state = MeshState::Parsing;
+            const bool loaded = binary ? ReadBinary(*target, binary) : ParseObj(*target);
+            target->state = loaded && target->indexSource.Size() > 0 ? MeshState::Parsed : MeshState::Failed; });
+
+        return static_cast<MeshId>(meshes.size() - 1);
+    }
+
+    // Stages at most uploadBudget bytes of parsed mesh data. Must run on the main
+    // thread before the staging belt is flushed for the frame.
+    void Update(uint64_t uploadBudget = defaultUploadBudget)
+    {
+        for (auto &mesh : meshes)
+        {
+            if (mesh->state == MeshState::Parsed)
+            {
+                BeginUpload(*mesh);
+            }
+
+            if (mesh->state != MeshState::Uploading)
+            {
+                continue;
+            }
+
+            if (!Stage(*mesh, mesh->vertexRange, mesh->vertexSource, mesh->vertexBytesStaged, uploadBudget) ||
+                !Stage(*mesh, mesh->indexRange, mesh->indexSource, mesh->indexBytesStaged, uploadBudget))
+            {
+                return;
+            }
+        }
+    }
+
+    MeshState GetState(MeshId id)
+    {
+        return meshes[id]->state;
+    }
+
+    // False until every byte of the mesh was copied by an already recorded
+    // command, i.e. after the staging belt flush of the current frame.
+    bool GetDrawInfo(MeshId id, MeshDrawInfo &info)
+    {
+        StreamedMesh &mesh = *meshes[id];
+
+        if (mesh.state == MeshState::Uploading && IsFullyStaged(mesh) && mesh.pendingCopies.load(std::memory_order_acquire) == 0)
+        {
+            mesh.state = MeshState::Resident;
+            mesh.vertexSource = {};
+            mesh.indexSource = {};
+            mesh.data = {};
+            mesh.asset = {};
+        }
+
+        if (mesh.state != MeshState::Resident)
+        {
+            return false;
+        }
+
+        info.vertexBuffer = bufferPool.GetBuffer(mesh.vertexRange);
+        info.vertexOffset = bufferPool.Offset(mesh.vertexRange);
+        info.vertexSize = mesh.vertexRange.size;
+        info.indexBuffer = bufferPool.GetBuffer(mesh.indexRange);
+        info.indexOffset = bufferPool.Offset(mesh.indexRange);
+        info.indexSize = mesh.indexRange.size;
+        info.indexCount = mesh.indexCount;
+        info.meshlets = mesh.meshlets;
+        info.lods = mesh.lods;
+        return true;
+    }
+
+    // Waits for parsing jobs still referencing our meshes and frees their ranges.
+    void Terminate()
+    {
+        jobs.WaitIdle();
+        for (auto &mesh : meshes)
+        {
+            bufferPool.Free(mesh->vertexRange);
+            bufferPool.Free(mesh->indexRange);
+        }
+        meshes.clear();
+    }
+
+private:
+    bool ParseObj(StreamedMesh &mesh)
+    {
+        bool loaded = false;
+        if (AssetView asset = assetReader.Open(mesh.path))
+        {
+            asset.Sequential();
+            loaded = Loader::LoadMeshFromObj(asset.bytes, mesh.path.parent_path(), mesh.data, &assetReader);
+        }
+        assetReader.Release(mesh.path);
+
+        // Packed meshes come with meshlets and complete attributes, loose ones get them here
+        if (loaded)
+        {
+            GenerateAttributes(mesh.data, jobs);
+            BuildMeshlets(mesh.data);
+            mesh.meshlets = mesh.data.meshlets;
+        }
+
+        mesh.vertexSource.raw = std::as_bytes(std::span(mesh.data.vertices));
+        mesh.indexSource.raw = std::as_bytes(std::span(mesh.data.indices));
+        return loaded;
+    }
+
+    bool ReadBinary(StreamedMesh &mesh, const AssetView &asset)
+    {
+        Loader::MeshBlob blob;
+        if (!Loader::ParseMeshBlob(asset.bytes, blob))
+        {
+            LogError("Mesh streaming: invalid binary mesh [{}]", mesh.path.string());
+            return false;
+        }
+        // The view keeps the mapping alive, the reader's cache can let go
+        mesh.asset = asset;
+        assetReader.Release(fs::path(mesh.path).replace_extension(".mesh"));
+        Loader::ReadMeshTables(blob, mesh.meshlets, mesh.lods);
+
+        const bool compressed = blob.header.compression != Compression::None;
+        mesh.vertexSource.compressed = compressed;
+        mesh.indexSource.compressed = compressed;
+        if (!compressed)
+        {
+            mesh.vertexSource.raw = blob.vertexStream;
+            mesh.indexSource.raw = blob.indexStream;
+        }
+        else if (!CompressionAvailable(blob.header.compression) ||
+                 !mesh.vertexSource.chunked.Parse(blob.vertexStream) || !mesh.indexSource.chunked.Parse(blob.indexStream))
+        {
+            LogError("Mesh streaming: cannot decompress {} mesh [{}]", CompressionName(blob.header.compression), mesh.path.string());
+            return false;
+        }
+
+        return mesh.vertexSource.Size() == uint64_t(blob.header.vertexCount) * blob.header.vertexStride &&
+               mesh.indexSource.Size() == uint64_t(blob.header.indexCount) * sizeof(uint32_t);
+    }
+
+    void BeginUpload(StreamedMesh &mesh)
+    {
+        const uint64_t vertexBytes = mesh.vertexSource.Size();
+        const uint64_t indexBytes = mesh.indexSource.Size();
+
+        mesh.vertexRange = bufferPool.Allocate(BufferClass::Vertex, vertexBytes);
+        mesh.indexRange = bufferPool.Allocate(BufferClass::Index, indexBytes);
+        if (!mesh.vertexRange || !mesh.indexRange)
+        {
+            LogError("Mesh streaming: no GPU memory for [{}]", mesh.path.string());
+            bufferPool.Free(mesh.vertexRange);
+            bufferPool.Free(mesh.indexRange);
+            mesh.state = MeshState::Failed;
+            return;
+        }
+
+        mesh.indexCount = static_cast<uint32_t>(indexBytes / sizeof(uint32_t));
+        mesh.state = MeshState::Uploading;
+    }
+
+    bool IsFullyStaged(const StreamedMesh &mesh) const
+    {
+        return mesh.vertexBytesStaged == mesh.vertexRange.size && mesh.indexBytesStaged == mesh.indexRange.size;
+    }
+
+    // Returns false once the frame's budget is spent.
+    bool Stage(StreamedMesh &mesh, const BufferRange &range, const StreamSource &source, uint64_t &staged, uint64_t &budget)
+    {
+        const uint64_t size = source.Size();
+        while (staged < size && mesh.state == MeshState::Uploading)
+        {
+            // Slices stay 4 byte aligned as required by buffer copies
+            uint64_t slice = std::min({size - staged, budget, stagingBelt.ChunkSize()}) & ~uint64_t(3);
+
+            // Compressed data is staged in whole chunks, at least one per frame
+            const uint32_t chunkSize = source.chunked.ChunkSize();
+            const uint32_t firstChunk = source.compressed ? static_cast<uint32_t>(staged / chunkSize) : 0;
+            uint32_t chunkCount = 0;
+            if (source.compressed && budget > 0)
+            {
+                chunkCount = std::min<uint32_t>(std::max<uint64_t>(slice / chunkSize, 1), source.chunked.ChunkCount() - firstChunk);
+                slice = std::min<uint64_t>(uint64_t(chunkCount) * chunkSize, size - staged);
+            }
+
+            if (slice == 0)
+            {
+                return false;
+            }
+
+            StagingWrite write = stagingBelt.Allocate(range, staged, slice);
+            if (!write)
+            {
+                return false;
+            }
+
+            if (!source.compressed)
+            {
+                std::memcpy(write.data, source.raw.data() + staged, slice);
+            }
+            else if (!source.chunked.Decompress(jobs, firstChunk, chunkCount, {write.data, slice}))
+            {
+                // Nothing more of it is copied, the budget goes to other meshes
+                LogError("Mesh streaming: corrupt chunk in [{}]", mesh.path.string());
+                mesh.state = MeshState::Failed;
+                stagingBelt.Abandon(write);
+                return true;
+            }
+            stagingBelt.Commit(write, &mesh.pendingCopies);
+
+            staged += slice;
+            budget -= std::min(budget, slice);
+        }
+        return true;
+    }
+
+    JobSystem &jobs;
+    AssetReader &assetReader;
+    BufferPool &bufferPool;
+    StagingBelt &stagingBelt;
+    std::vector<std::unique_ptr<StreamedMesh>> meshes;
+};
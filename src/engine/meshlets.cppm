@@ -0,0 +1,277 @@
+export module meshlets;
+
+import <algorithm>;
+import <cmath>;
+import <cstdint>;
+import <limits>;
+import <span>;
+import <vector>;
+
+import loader;
+
+export constexpr uint32_t maxMeshletVertices = 64;
+export constexpr uint32_t maxMeshletTriangles = 124;
+
+// Smallest-ish sphere around the points (Ritter), good enough for culling.
+export vec4 BoundingSphere(std::span<const vec3> points)
+{
+    if (points.empty())
+    {
+        return vec4(0.0f);
+    }
+
+    const auto farthestFrom = [&](vec3 from)
+    {
+        vec3 farthest = points[0];
+        float best = -1.0f;
+        for (const vec3 &point : points)
+        {
+            const vec3 d = point - from;
+            const float distance = glm::dot(d, d);
+            if (distance > best)
+            {
+                best = distance;
+                farthest = point;
+            }
+        }
+        return farthest;
+    };
+
+    const vec3 a = farthestFrom(points[0]);
+    const vec3 b = farthestFrom(a);
+    vec3 center = (a + b) * 0.5f;
+    float radius = glm::length(b - a) * 0.5f;
+
+    for (const vec3 &point : points)
+    {
+        const float distance = glm::length(point - center);
+        if (distance > radius)
+        {
+            const float grown = (radius + distance) * 0.5f;
+            center += (point - center) * ((grown - radius) / distance);
+            radius = grown;
+        }
+    }
+    return vec4(center, radius);
+}
+
+// Cone containing every triangle normal of the cluster. The cutoff is the sine
+// of the half angle (the test in CullMeshlets works on it), 1 when the normals
+// spread too far for the cone to ever cull.
+vec4 NormalCone(std::span<const vec3> normals)
+{
+    vec3 sum(0.0f);
+    for (const vec3 &normal : normals)
+    {
+        sum += normal;
+    }
+
+    const float length = glm::length(sum);
+    if (length < 1e-6f)
+    {
+        return vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    }
+
+    const vec3 axis = sum / length;
+    float minDot = 1.0f;
+    for (const vec3 &normal : normals)
+    {
+        minDot = std::min(minDot, glm::dot(axis, normal));
+    }
+
+    // Beyond ~84 degrees the cone hardly ever culls anything
+    if (minDot <= 0.1f)
+    {
+        return vec4(axis, 1.0f);
+    }
+    return vec4(axis, std::sqrt(1.0f - minDot * minDot));
+}
+
+void FinishMeshlet(std::span<const Loader::VertexAttributes> vertices, std::span<const uint32_t> indices, uint32_t vertexCount, Loader::Meshlet &meshlet)
+{
+    std::vector<vec3> points;
+    std::vector<vec3> normals;
+    points.reserve(indices.size());
+    normals.reserve(indices.size() / 3);
+
+    for (size_t i = 0; i + 2 < indices.size(); i += 3)
+    {
+        const vec3 &p0 = vertices[indices[i]].position;
+        const vec3 &p1 = vertices[indices[i + 1]].position;
+        const vec3 &p2 = vertices[indices[i + 2]].position;
+        points.insert(points.end(), {p0, p1, p2});
+
+        const vec3 normal = glm::cross(p1 - p0, p2 - p0);
+        const float area = glm::length(normal);
+        // Degenerate triangles have no say in the cone
+        if (area > 1e-12f)
+        {
+            normals.push_back(normal / area);
+        }
+    }
+
+    meshlet.sphere = BoundingSphere(points);
+    meshlet.cone = NormalCone(normals);
+    meshlet.vertexCount = vertexCount;
+}
+
+// Splits the triangles into meshlets of at most maxVertices unique vertices and
+// maxTriangles triangles, reordering the indices so every meshlet is one
+// contiguous range. Triangles are grown greedily from their neighbours,
+// preferring those adding the fewest new vertices, which keeps clusters
+// compact and their bounds and cones tight.
+export void BuildMeshlets(std::span<const Loader::VertexAttributes> vertices, std::vector<uint32_t> &indices, std::vector<Loader::Meshlet> &meshlets,
+                          uint32_t maxVertices = maxMeshletVertices, uint32_t maxTriangles = maxMeshletTriangles)
+{
+    constexpr uint32_t invalid = std::numeric_limits<uint32_t>::max();
+
+    meshlets.clear();
+    const uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+    const uint32_t vertexCount = static_cast<uint32_t>(vertices.size());
+    if (triangleCount == 0 || maxVertices < 3 || maxTriangles == 0)
+    {
+        return;
+    }
+
+    // Triangles using each vertex, compressed rows
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+    for (uint32_t index : indices)
+    {
+        adjacencyOffsets[index + 1]++;
+    }
+    for (uint32_t v = 0; v < vertexCount; ++v)
+    {
+        adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+    }
+    std::vector<uint32_t> adjacency(indices.size());
+    {
+        std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (uint32_t i = 0; i < indices.size(); ++i)
+        {
+            adjacency[fill[indices[i]]++] = i / 3;
+        }
+    }
+
+    std::vector<uint32_t> reordered;
+    reordered.reserve(indices.size());
+    std::vector<bool> emitted(triangleCount, false);
+    // Id of the meshlet a vertex was last added to
+    std::vector<uint32_t> vertexMeshlet(vertexCount, invalid);
+    std::vector<uint32_t> candidates;
+    // Id of the meshlet a triangle was last made a candidate for, avoids duplicates
+    std::vector<uint32_t> candidateMeshlet(triangleCount, invalid);
+
+    uint32_t meshletId = 0;
+    uint32_t meshletVertices = 0;
+    uint32_t meshletTriangles = 0;
+    uint32_t meshletFirstIndex = 0;
+    uint32_t emittedCount = 0;
+    uint32_t cursor = 0;
+
+    const auto newVertices = [&](uint32_t triangle)
+    {
+        uint32_t count = 0;
+        for (uint32_t k = 0; k < 3; ++k)
+        {
+            count += vertexMeshlet[indices[triangle * 3 + k]] != meshletId;
+        }
+        return count;
+    };
+
+    const auto finish = [&]()
+    {
+        Loader::Meshlet meshlet;
+        meshlet.firstIndex = meshletFirstIndex;
+        meshlet.indexCount = static_cast<uint32_t>(reordered.size()) - meshletFirstIndex;
+        FinishMeshlet(vertices, std::span(reordered).subspan(meshletFirstIndex), meshletVertices, meshlet);
+        meshlets.push_back(meshlet);
+
+        meshletId++;
+        meshletVertices = 0;
+        meshletTriangles = 0;
+        meshletFirstIndex = static_cast<uint32_t>(reordered.size());
+    };
+
+    while (emittedCount < triangleCount)
+    {
+        // Best neighbour that still fits, dropping emitted candidates on the way
+        uint32_t best = invalid;
+        uint32_t bestScore = invalid;
+        size_t kept = 0;
+        for (size_t i = 0; i < candidates.size(); ++i)
+        {
+            const uint32_t triangle = candidates[i];
+            if (emitted[triangle])
+            {
+                continue;
+            }
+            candidates[kept++] = triangle;
+
+            const uint32_t score = newVertices(triangle);
+            if (score < bestScore && meshletVertices + score <= maxVertices)
+            {
+                best = triangle;
+                bestScore = score;
+            }
+        }
+        candidates.resize(kept);
+
+        if (meshletTriangles == maxTriangles || (best == invalid && meshletTriangles > 0))
+        {
+            finish();
+
+            // The next meshlet starts next to this one when possible
+            if (!candidates.empty())
+            {
+                const uint32_t seed = candidates.front();
+                candidates.assign(1, seed);
+                candidateMeshlet[seed] = meshletId;
+            }
+            continue;
+        }
+
+        if (best == invalid)
+        {
+            while (emitted[cursor])
+            {
+                cursor++;
+            }
+            best = cursor;
+        }
+
+        emitted[best] = true;
+        emittedCount++;
+        meshletTriangles++;
+        for (uint32_t k = 0; k < 3; ++k)
+        {
+            const uint32_t vertex = indices[best * 3 + k];
+            reordered.push_back(vertex);
+            if (vertexMeshlet[vertex] != meshletId)
+            {
+                vertexMeshlet[vertex] = meshletId;
+                meshletVertices++;
+            }
+            for (uint32_t a = adjacencyOffsets[vertex]; a < adjacencyOffsets[vertex + 1]; ++a)
+            {
+                const uint32_t triangle = adjacency[a];
+                if (!emitted[triangle] && candidateMeshlet[triangle] != meshletId)
+                {
+                    candidateMeshlet[triangle] = meshletId;
+                    candidates.push_back(triangle);
+                }
+            }
+        }
+    }
+
+    if (meshletTriangles > 0)
+    {
+        finish();
+    }
+
+    indices = std::move(reordered);
+}
+
+export void BuildMeshlets(Loader::Mesh &mesh, uint32_t maxVertices = maxMeshletVertices, uint32_t maxTriangles = maxMeshletTriangles)
+{
+    BuildMeshlets(mesh.vertices, mesh.indices, mesh.meshlets, maxVertices, maxTriangles);
+}
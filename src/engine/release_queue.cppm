@@ -0,0 +1,113 @@
+module;
+
+#include <webgpu/webgpu.hpp>
+
+export module release_queue;
+
+import <deque>;
+import <functional>;
+import <memory>;
+import <utility>;
+
+using namespace wgpu;
+
+// Holds GPU objects that may still be referenced by submitted command buffers
+// until the queue reports that the frame they were retired in has completed.
+export class ReleaseQueue
+{
+public:
+    ReleaseQueue() {};
+
+    ReleaseQueue(const ReleaseQueue &) = delete;
+    ReleaseQueue &operator=(const ReleaseQueue &) = delete;
+
+    // Takes ownership of the object and clears the caller's handle.
+    template <typename T>
+    void Retire(T &object)
+    {
+        if (!object)
+        {
+            return;
+        }
+
+        T retired = object;
+        object = nullptr;
+
+        pending.push_back({frameIndex, [retired]() mutable
+                           {
+                               if constexpr (requires { retired.destroy(); })
+                               {
+                                   retired.destroy();
+                               }
+                               retired.release();
+                           }});
+    }
+
+    // Must be called right after the frame's command buffers were submitted.
+    void Submit(Queue &queue)
+    {
+        const uint64_t frame = frameIndex++;
+
+        fences.push_back({frame, queue.onSubmittedWorkDone([this, frame](QueueWorkDoneStatus)
+                                                           {
+                                                               if (frame + 1 > completedFrames)
+                                                               {
+                                                                   completedFrames = frame + 1;
+                                                               } })});
+    }
+
+    // Releases everything retired in frames the GPU has finished. Completion
+    // callbacks only fire while the device is polled, so call this after it.
+    void Collect()
+    {
+        while (!pending.empty() && pending.front().frame < completedFrames)
+        {
+            pending.front().release();
+            pending.pop_front();
+        }
+
+        while (!fences.empty() && fences.front().first < completedFrames)
+        {
+            fences.pop_front();
+        }
+    }
+
+    // Releases everything regardless of GPU progress, only valid on shutdown.
+    void Flush()
+    {
+        for (auto &entry : pending)
+        {
+            entry.release();
+        }
+        pending.clear();
+        fences.clear();
+        completedFrames = frameIndex;
+    }
+
+    uint64_t FrameIndex() const
+    {
+        return frameIndex;
+    }
+
+    uint64_t CompletedFrames() const
+    {
+        return completedFrames;
+    }
+
+    size_t PendingCount() const
+    {
+        return pending.size();
+    }
+
+private:
+    struct Entry
+    {
+        uint64_t frame;
+        std::function<void()> release;
+    };
+
+    std::deque<Entry> pending;
+    std::deque<std::pair<uint64_t, std::unique_ptr<QueueWorkDoneCallback>>> fences;
+    uint64_t frameIndex = 0;
+    uint64_t completedFrames = 0;
+};
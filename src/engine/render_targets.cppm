@@ -0,0 +1,151 @@
+module;
+
+#include <webgpu/webgpu.hpp>
+
+export module render_targets;
+
+import <cstdint>;
+import <vector>;
+
+import resources;
+
+using namespace wgpu;
+
+export struct RenderTarget
+{
+    Handle<Texture> texture;
+    Handle<TextureView> view;
+    uint32_t width = 0;
+    uint32_t height = 0;
+
+    explicit operator bool() const
+    {
+        return static_cast<bool>(view);
+    }
+};
+
+export struct RenderTargetStats
+{
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint32_t live = 0;
+};
+
+// Keeps the most recently used attachments alive so going back and forth
+// between sizes (dragging a window edge) finds them again instead of creating
+// new textures. All attachments of a pass must have the same size in WebGPU,
+// so entries match exactly, there is no rounding up to size buckets.
+// Acquire every frame: a target stays valid until capacity others were used
+// more recently, eviction goes through the release queue so frames still on
+// the GPU are safe.
+export class RenderTargetCache
+{
+public:
+    explicit RenderTargetCache(ResourceRegistry &inResources, uint32_t inCapacity = 4) : resources(inResources), capacity(inCapacity) {};
+
+    RenderTargetCache(const RenderTargetCache &) = delete;
+    RenderTargetCache &operator=(const RenderTargetCache &) = delete;
+
+    RenderTarget Acquire(Device &device, uint32_t width, uint32_t height, TextureFormat format, WGPUTextureUsageFlags usage,
+                         TextureAspect aspect = TextureAspect::All, const char *label = "Render target")
+    {
+        clock++;
+        for (Entry &entry : entries)
+        {
+            if (entry.target.width == width && entry.target.height == height && entry.format == format && entry.usage == usage &&
+                entry.aspect == aspect)
+            {
+                entry.lastUse = clock;
+                stats.hits++;
+                return entry.target;
+            }
+        }
+        stats.misses++;
+
+        if (entries.size() >= capacity)
+        {
+            Entry *oldest = &entries.front();
+            for (Entry &entry : entries)
+            {
+                if (entry.lastUse < oldest->lastUse)
+                {
+                    oldest = &entry;
+                }
+            }
+            Release(*oldest);
+            *oldest = entries.back();
+            entries.pop_back();
+        }
+
+        TextureDescriptor textureDesc;
+        textureDesc.label = label;
+        textureDesc.dimension = TextureDimension::_2D;
+        textureDesc.format = format;
+        textureDesc.mipLevelCount = 1;
+        textureDesc.sampleCount = 1;
+        textureDesc.size = {width, height, 1};
+        textureDesc.usage = usage;
+        textureDesc.viewFormatCount = 1;
+        textureDesc.viewFormats = (WGPUTextureFormat *)&format;
+
+        Entry entry;
+        entry.format = format;
+        entry.usage = usage;
+        entry.aspect = aspect;
+        entry.lastUse = clock;
+        entry.target.width = width;
+        entry.target.height = height;
+        entry.target.texture = resources.CreateTexture(device, textureDesc);
+
+        TextureViewDescriptor viewDesc;
+        viewDesc.aspect = aspect;
+        viewDesc.baseArrayLayer = 0;
+        viewDesc.arrayLayerCount = 1;
+        viewDesc.baseMipLevel = 0;
+        viewDesc.mipLevelCount = 1;
+        viewDesc.dimension = TextureViewDimension::_2D;
+        viewDesc.format = format;
+        entry.target.view = resources.Add(resources.Get(entry.target.texture).createView(viewDesc), 0, label);
+
+        entries.push_back(entry);
+        return entry.target;
+    }
+
+    RenderTargetStats Stats() const
+    {
+        RenderTargetStats result = stats;
+        result.live = static_cast<uint32_t>(entries.size());
+        return result;
+    }
+
+    void Terminate()
+    {
+        for (Entry &entry : entries)
+        {
+            Release(entry);
+        }
+        entries.clear();
+    }
+
+private:
+    struct Entry
+    {
+        RenderTarget target;
+        TextureFormat format = TextureFormat::Undefined;
+        WGPUTextureUsageFlags usage = 0;
+        TextureAspect aspect = TextureAspect::All;
+        uint64_t lastUse = 0;
+    };
+
+    void Release(Entry &entry)
+    {
+        resources.Release(entry.target.view);
+        resources.Release(entry.target.texture);
+    }
+
+    ResourceRegistry &resources;
+    uint32_t capacity;
+    std::vector<Entry> entries;
+    uint64_t clock = 0;
+    RenderTargetStats stats;
+};
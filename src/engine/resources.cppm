@@ -0,0 +1,326 @@
+module;
+
+#include <webgpu/webgpu.hpp>
+
+export module resources;
+
+import <algorithm>;
+import <cstdint>;
+import <iostream>;
+import <string>;
+import <tuple>;
+import <type_traits>;
+import <vector>;
+
+import release_queue;
+
+using namespace wgpu;
+
+// Typed generational handle. A handle outliving its resource is detected by
+// the generation mismatch instead of aliasing whatever reused the slot.
+export template <typename T>
+struct Handle
+{
+    static constexpr uint32_t invalidIndex = 0xffffffffu;
+
+    uint32_t index = invalidIndex;
+    uint32_t generation = 0;
+
+    explicit operator bool() const
+    {
+        return index != invalidIndex;
+    }
+
+    bool operator==(const Handle &) const = default;
+};
+
+export struct ResourceStats
+{
+    const char *type;
+    size_t count;
+    uint64_t bytes;
+};
+
+template <typename T>
+constexpr const char *ResourceTypeName()
+{
+    if constexpr (std::is_same_v<T, Buffer>)
+        return "Buffer";
+    else if constexpr (std::is_same_v<T, Texture>)
+        return "Texture";
+    else if constexpr (std::is_same_v<T, TextureView>)
+        return "TextureView";
+    else if constexpr (std::is_same_v<T, Sampler>)
+        return "Sampler";
+    else if constexpr (std::is_same_v<T, BindGroup>)
+        return "BindGroup";
+    else if constexpr (std::is_same_v<T, BindGroupLayout>)
+        return "BindGroupLayout";
+    else if constexpr (std::is_same_v<T, PipelineLayout>)
+        return "PipelineLayout";
+    else if constexpr (std::is_same_v<T, RenderPipeline>)
+        return "RenderPipeline";
+    else if constexpr (std::is_same_v<T, ComputePipeline>)
+        return "ComputePipeline";
+    else if constexpr (std::is_same_v<T, ShaderModule>)
+        return "ShaderModule";
+    else if constexpr (std::is_same_v<T, QuerySet>)
+        return "QuerySet";
+    else
+        return "Unknown";
+}
+
+// Sparse slots indexed by handle, pointing into densely packed objects so that
+// iteration, insertion and removal are all O(1) per resource.
+template <typename T>
+class ResourcePool
+{
+public:
+    struct Entry
+    {
+        T object;
+        uint32_t slot;
+        uint32_t refCount;
+        uint64_t size;
+        std::string label;
+    };
+
+    Handle<T> Add(T object, uint64_t size, std::string label)
+    {
+        uint32_t slotIndex;
+        if (freeHead != Handle<T>::invalidIndex)
+        {
+            slotIndex = freeHead;
+            freeHead = slots[slotIndex].dense;
+        }
+        else
+        {
+            slotIndex = static_cast<uint32_t>(slots.size());
+            slots.push_back({0, 0});
+        }
+
+        slots[slotIndex].dense = static_cast<uint32_t>(objects.size());
+        objects.push_back({object, slotIndex, 1, size, std::move(label)});
+        bytes += size;
+
+        return {slotIndex, slots[slotIndex].generation};
+    }
+
+    Entry *Find(Handle<T> handle)
+    {
+        if (handle.index >= slots.size() || slots[handle.index].generation != handle.generation)
+        {
+            return nullptr;
+        }
+        return &objects[slots[handle.index].dense];
+    }
+
+    // Removes the entry and returns the object so the caller decides how it dies.
+    T Remove(Handle<T> handle)
+    {
+        Slot &slot = slots[handle.index];
+        const uint32_t dense = slot.dense;
+        T object = objects[dense].object;
+        bytes -= objects[dense].size;
+
+        if (dense + 1 != objects.size())
+        {
+            objects[dense] = std::move(objects.back());
+            slots[objects[dense].slot].dense = dense;
+        }
+        objects.pop_back();
+
+        slot.generation++;
+        slot.dense = freeHead;
+        freeHead = handle.index;
+
+        return object;
+    }
+
+    Handle<T> HandleAt(size_t dense) const
+    {
+        const uint32_t slot = objects[dense].slot;
+        return {slot, slots[slot].generation};
+    }
+
+    ResourceStats Stats() const
+    {
+        return {ResourceTypeName<T>(), objects.size(), bytes};
+    }
+
+    std::vector<Entry> objects;
+
+private:
+    struct Slot
+    {
+        // Index into objects while alive, next free slot once released
+        uint32_t dense;
+        uint32_t generation;
+    };
+
+    std::vector<Slot> slots;
+    uint32_t freeHead = Handle<T>::invalidIndex;
+    uint64_t bytes = 0;
+};
+
+export uint32_t BytesPerTexel(TextureFormat format)
+{
+    switch (format)
+    {
+    case TextureFormat::R8Unorm:
+        return 1;
+    case TextureFormat::RG8Unorm:
+    case TextureFormat::R16Float:
+        return 2;
+    case TextureFormat::RGBA16Float:
+    case TextureFormat::RG32Float:
+        return 8;
+    case TextureFormat::RGBA32Float:
+        return 16;
+    default:
+        return 4;
+    }
+}
+
+// Owns every GPU object the engine creates at runtime. Objects are reference
+// counted through their handles; the last Release hands them to the release
+// queue so in-flight frames can finish using them.
+export class ResourceRegistry
+{
+public:
+    ResourceRegistry(ReleaseQueue &inReleaseQueue) : releaseQueue(inReleaseQueue) {};
+
+    ResourceRegistry(const ResourceRegistry &) = delete;
+    ResourceRegistry &operator=(const ResourceRegistry &) = delete;
+
+    template <typename T>
+    Handle<T> Add(T object, uint64_t bytes = 0, std::string label = {})
+    {
+        if (!object)
+        {
+            return {};
+        }
+        return Pool<T>().Add(object, bytes, std::move(label));
+    }
+
+    Handle<Buffer> CreateBuffer(Device &device, const BufferDescriptor &desc)
+    {
+        return Add(device.createBuffer(desc), desc.size, desc.label ? desc.label : "");
+    }
+
+    Handle<Texture> CreateTexture(Device &device, const TextureDescriptor &desc)
+    {
+        uint64_t bytes = 0;
+        for (uint32_t mip = 0; mip < desc.mipLevelCount; ++mip)
+        {
+            const uint64_t width = std::max(desc.size.width >> mip, 1u);
+            const uint64_t height = std::max(desc.size.height >> mip, 1u);
+            bytes += width * height * desc.size.depthOrArrayLayers * BytesPerTexel(desc.format);
+        }
+        bytes *= desc.sampleCount;
+        return Add(device.createTexture(desc), bytes, desc.label ? desc.label : "");
+    }
+
+    // Returns a null object when the handle is stale or empty.
+    template <typename T>
+    T Get(Handle<T> handle)
+    {
+        auto *entry = Pool<T>().Find(handle);
+        return entry ? entry->object : T(nullptr);
+    }
+
+    template <typename T>
+    bool IsAlive(Handle<T> handle)
+    {
+        return Pool<T>().Find(handle) != nullptr;
+    }
+
+    template <typename T>
+    Handle<T> AddRef(Handle<T> handle)
+    {
+        if (auto *entry = Pool<T>().Find(handle))
+        {
+            entry->refCount++;
+        }
+        return handle;
+    }
+
+    // Drops one reference and clears the caller's handle.
+    template <typename T>
+    void Release(Handle<T> &handle)
+    {
+        auto &pool = Pool<T>();
+        if (auto *entry = pool.Find(handle); entry && --entry->refCount == 0)
+        {
+            T object = pool.Remove(handle);
+            releaseQueue.Retire(object);
+        }
+        handle = {};
+    }
+
+    std::vector<ResourceStats> Stats() const
+    {
+        std::vector<ResourceStats> stats;
+        std::apply([&](const auto &...pool)
+                   { (stats.push_back(pool.Stats()), ...); },
+                   pools);
+        return stats;
+    }
+
+    void PrintStats(std::ostream &out) const
+    {
+        for (const auto &stat : Stats())
+        {
+            if (stat.count > 0)
+            {
+                out << stat.type << ": " << stat.count << " live, " << stat.bytes << " bytes" << std::endl;
+            }
+        }
+    }
+
+    // Reports and retires everything still alive. Returns the number of leaks.
+    size_t ReportLeaks(std::ostream &out)
+    {
+        size_t leaks = 0;
+        std::apply([&](auto &...pool)
+                   { (ReportLeaks(pool, out, leaks), ...); },
+                   pools);
+        return leaks;
+    }
+
+private:
+    template <typename T>
+    ResourcePool<T> &Pool()
+    {
+        return std::get<ResourcePool<T>>(pools);
+    }
+
+    template <typename T>
+    void ReportLeaks(ResourcePool<T> &pool, std::ostream &out, size_t &leaks)
+    {
+        while (!pool.objects.empty())
+        {
+            const auto &entry = pool.objects.back();
+            out << "Leaked " << ResourceTypeName<T>() << " '" << entry.label << "' ("
+                << entry.size << " bytes, " << entry.refCount << " refs)" << std::endl;
+
+            T object = pool.Remove(pool.HandleAt(pool.objects.size() - 1));
+            releaseQueue.Retire(object);
+            leaks++;
+        }
+    }
+
+    ReleaseQueue &releaseQueue;
+    std::tuple<ResourcePool<Buffer>,
+               ResourcePool<Texture>,
+               ResourcePool<TextureView>,
+               ResourcePool<Sampler>,
+               ResourcePool<BindGroup>,
+               ResourcePool<BindGroupLayout>,
+               ResourcePool<PipelineLayout>,
+               ResourcePool<RenderPipeline>,
+               ResourcePool<ComputePipeline>,
+               ResourcePool<ShaderModule>,
+               ResourcePool<QuerySet>>
+        pools;
+};
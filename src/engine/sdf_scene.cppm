@@ -0,0 +1,516 @@
+export module sdf_scene;
+
+import <cmath>;
+import <cstdint>;
+import <limits>;
+import <locale>;
+import <numbers>;
+import <sstream>;
+import <string>;
+import <vector>;
+
+import loader;
+import shapes;
+
+export using SdfNodeId = uint32_t;
+
+export enum class SdfOp : uint32_t
+{
+    Shape,
+    // The child at transform(p)
+    Transform,
+    // The child's distance minus radius
+    Round,
+    Union,
+    // a without b
+    Subtract,
+    SmoothUnion,
+    SmoothSubtract,
+};
+
+struct SdfNode
+{
+    SdfOp op = SdfOp::Shape;
+    ShapeType shape = ShapeType::Box;
+    vec4 params = vec4(0.0f);
+    Affine2 transform;
+    // Radius of Round, blend width of the smooth operations
+    float size = 0.0f;
+    SdfNodeId a = 0;
+    SdfNodeId b = 0;
+};
+
+// Fills with color where the distance of node is below zero, fading out
+// until edge like the shapes of shapes.wgsl
+struct SdfLayer
+{
+    SdfNodeId node;
+    float edge;
+    vec4 color;
+};
+
+// A 2D signed distance scene over uv (y up): a graph of primitives,
+// transforms and combinations, painted as layers over the background. Nodes
+// are immutable and may be shared, a shared node is evaluated once per use.
+//
+// GenerateWgsl turns it into one straight-line WGSL function: every chain of
+// transforms is folded into a single affine map from uv, primitive constants
+// are computed up front and nothing is looked up at run time.
+export class SdfScene
+{
+public:
+    SdfNodeId Primitive(ShapeType type, vec4 params)
+    {
+        const SdfNodeId id = Add(SdfOp::Shape);
+        nodes[id].shape = type;
+        nodes[id].params = params;
+        return id;
+    }
+
+    SdfNodeId Transform(const Affine2 &transform, SdfNodeId child)
+    {
+        const SdfNodeId id = Add(SdfOp::Transform, child);
+        nodes[id].transform = transform;
+        return id;
+    }
+
+    SdfNodeId Translate(vec2 offset, SdfNodeId child)
+    {
+        return Transform(Affine2::Translate(offset), child);
+    }
+
+    SdfNodeId Scale(vec2 scale, SdfNodeId child)
+    {
+        return Transform(Affine2::Scale(scale), child);
+    }
+
+    // rotateUV of the shaders
+    SdfNodeId RotateUV(float angle, SdfNodeId child)
+    {
+        return Transform(Affine2::RotateUV(angle), child);
+    }
+
+    SdfNodeId Round(SdfNodeId child, float radius)
+    {
+        return Add(SdfOp::Round, child, 0, radius);
+    }
+
+    SdfNodeId Union(SdfNodeId a, SdfNodeId b)
+    {
+        return Add(SdfOp::Union, a, b);
+    }
+
+    SdfNodeId Subtract(SdfNodeId a, SdfNodeId b)
+    {
+        return Add(SdfOp::Subtract, a, b);
+    }
+
+    // Polynomial smooth minimum, blends over distances closer than k
+    SdfNodeId SmoothUnion(SdfNodeId a, SdfNodeId b, float k)
+    {
+        return Add(SdfOp::SmoothUnion, a, b, k);
+    }
+
+    SdfNodeId SmoothSubtract(SdfNodeId a, SdfNodeId b, float k)
+    {
+        return Add(SdfOp::SmoothSubtract, a, b, k);
+    }
+
+    // Layers are painted in the order they are added
+    void AddLayer(SdfNodeId node, float edge, vec4 color)
+    {
+        layers.push_back({node, edge, color});
+    }
+
+    // A fragment shader (fs_main) with its fullscreen triangle (vs_main)
+    // that paints the scene, for StaticPass
+    std::string GenerateWgsl() const
+    {
+        Generator generator(*this);
+        std::string body;
+        body += "    var c = " + Vec3(background) + ";\n";
+        for (const SdfLayer &layer : layers)
+        {
+            const std::string distance = generator.Emit(layer.node, Affine2{});
+            std::string coverage = "(1.0 - smoothstep(0.0, " + Literal(layer.edge) + ", " + distance + "))";
+            if (layer.color.a != 1.0f)
+            {
+                coverage += " * " + Literal(layer.color.a);
+            }
+            generator.code += "    c = mix(c, " + Vec3(layer.color) + ", " + coverage + ");\n";
+        }
+
+        std::string wgsl = "// Generated from an SdfScene, do not edit\n\n";
+        for (const char *helper : generator.Helpers())
+        {
+            wgsl += helper;
+        }
+        wgsl += "fn sceneColor(uv: vec2f) -> vec3f {\n" + body + generator.code + "    return c;\n}\n";
+        wgsl += fullscreenEntryPoints;
+        return wgsl;
+    }
+
+    // The scene as shapes for ShapeRenderer, when every layer is a union of
+    // transformed primitives. The primitives of a union become shapes of
+    // their own, painted one after the other.
+    bool ToShapes(std::vector<Shape> &shapes) const
+    {
+        shapes.clear();
+        for (const SdfLayer &layer : layers)
+        {
+            if (!Flatten(layer.node, Affine2{}, layer, shapes))
+            {
+                shapes.clear();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    vec4 background = vec4(1.0f);
+
+private:
+    struct Generator
+    {
+        explicit Generator(const SdfScene &inScene) : scene(inScene) {};
+
+        const SdfScene &scene;
+        std::string code;
+        uint32_t values = 0;
+        bool box = false;
+        bool vesica = false;
+        bool egg = false;
+        bool roundedCross = false;
+        bool smooth = false;
+
+        // Declares the distance of node at uvToNode(uv), returns its name
+        std::string Emit(SdfNodeId id, const Affine2 &uvToNode)
+        {
+            const SdfNode &node = scene.nodes[id];
+            switch (node.op)
+            {
+            case SdfOp::Shape:
+                return Declare(Primitive(node, Coordinates(uvToNode)));
+            case SdfOp::Transform:
+                return Emit(node.a, uvToNode.Then(node.transform));
+            case SdfOp::Round:
+                return Declare(Emit(node.a, uvToNode) + " - " + Literal(node.size));
+            case SdfOp::Union:
+            {
+                const std::string a = Emit(node.a, uvToNode);
+                return Declare("min(" + a + ", " + Emit(node.b, uvToNode) + ")");
+            }
+            case SdfOp::Subtract:
+            {
+                const std::string a = Emit(node.a, uvToNode);
+                return Declare("max(" + a + ", -" + Emit(node.b, uvToNode) + ")");
+            }
+            case SdfOp::SmoothUnion:
+            case SdfOp::SmoothSubtract:
+            {
+                const bool subtract = node.op == SdfOp::SmoothSubtract;
+                const std::string a = Emit(node.a, uvToNode);
+                const std::string b = Emit(node.b, uvToNode);
+                // Without a blend width they are the sharp ones
+                if (node.size <= 0.0f)
+                {
+                    return Declare(subtract ? "max(" + a + ", -" + b + ")" : "min(" + a + ", " + b + ")");
+                }
+                smooth = true;
+                const std::string arguments = ", " + Literal(node.size) + ", " + Literal(1.0f / node.size) + ")";
+                // Subtracting b is the negated smooth minimum of -a and b
+                return Declare(subtract ? "-smoothUnion(-" + a + ", " + b + arguments : "smoothUnion(" + a + ", " + b + arguments);
+            }
+            }
+            return Declare("0.0");
+        }
+
+        std::string Declare(const std::string &expression)
+        {
+            const std::string name = "d" + std::to_string(values++);
+            code += "    let " + name + " = " + expression + ";\n";
+            return name;
+        }
+
+        // uv mapped by transform, skipping what is identity
+        static std::string Coordinates(const Affine2 &transform)
+        {
+            const glm::mat2 &m = transform.m;
+            std::string p = "uv";
+            if (m[0][1] != 0.0f || m[1][0] != 0.0f)
+            {
+                p = "mat2x2f(" + Literal(m[0][0]) + ", " + Literal(m[0][1]) + ", " + Literal(m[1][0]) + ", " + Literal(m[1][1]) + ") * uv";
+            }
+            else if (m[0][0] != 1.0f || m[1][1] != 1.0f)
+            {
+                p = "uv * " + Vec2(vec2(m[0][0], m[1][1]));
+            }
+            if (transform.t.x != 0.0f || transform.t.y != 0.0f)
+            {
+                p += " + " + Vec2(transform.t);
+            }
+            return p;
+        }
+
+        // Distance of a primitive, with what only depends on its parameters
+        // computed here
+        std::string Primitive(const SdfNode &node, const std::string &p)
+        {
+            const vec4 q = node.params;
+            switch (node.shape)
+            {
+            case ShapeType::Box:
+                box = true;
+                return "sdBox(" + p + ", " + Vec2(vec2(q.x, q.y)) + ")";
+            case ShapeType::Circle:
+                return "length(" + p + ") - " + Literal(q.x);
+            case ShapeType::Vesica:
+                vesica = true;
+                return "sdVesica(" + p + ", " + Literal(q.x) + ", " + Literal(q.y) + ", " + Literal(std::sqrt(q.x * q.x - q.y * q.y)) + ")";
+            case ShapeType::Egg:
+            {
+                egg = true;
+                const float ce = 0.5f * (q.x * q.x - (q.y - q.z) * (q.y - q.z)) / (q.y - q.z);
+                return "sdEgg(" + p + ", " + Literal(q.x) + ", " + Literal(q.y) + ", " + Literal(q.z) + ", " + Literal(ce) + ")";
+            }
+            case ShapeType::RoundedCross:
+                roundedCross = true;
+                return "sdRoundedCross(" + p + ", " + Literal(q.x) + ", " + Literal(0.5f * (q.x + 1.0f / q.x)) + ") - " + Literal(q.y);
+            }
+            return "0.0";
+        }
+
+        std::vector<const char *> Helpers() const
+        {
+            std::vector<const char *> helpers;
+            if (box)
+            {
+                helpers.push_back(sdBoxSource);
+            }
+            if (vesica)
+            {
+                helpers.push_back(sdVesicaSource);
+            }
+            if (egg)
+            {
+                helpers.push_back(sdEggSource);
+            }
+            if (roundedCross)
+            {
+                helpers.push_back(sdRoundedCrossSource);
+            }
+            if (smooth)
+            {
+                helpers.push_back(smoothUnionSource);
+            }
+            return helpers;
+        }
+    };
+
+    SdfNodeId Add(SdfOp op, SdfNodeId a = 0, SdfNodeId b = 0, float size = 0.0f)
+    {
+        SdfNode node;
+        node.op = op;
+        node.a = a;
+        node.b = b;
+        node.size = size;
+        nodes.push_back(node);
+        return static_cast<SdfNodeId>(nodes.size() - 1);
+    }
+
+    bool Flatten(SdfNodeId id, const Affine2 &uvToNode, const SdfLayer &layer, std::vector<Shape> &shapes) const
+    {
+        const SdfNode &node = nodes[id];
+        switch (node.op)
+        {
+        case SdfOp::Shape:
+            shapes.push_back(MakeShape(node.shape, node.params, uvToNode, layer.edge, layer.color));
+            return true;
+        case SdfOp::Transform:
+            return Flatten(node.a, uvToNode.Then(node.transform), layer, shapes);
+        case SdfOp::Union:
+            return Flatten(node.a, uvToNode, layer, shapes) && Flatten(node.b, uvToNode, layer, shapes);
+        default:
+            return false;
+        }
+    }
+
+    // Shortest decimal that reads back as value, always a float literal
+    static std::string Literal(float value)
+    {
+        std::string text;
+        for (const int precision : {6, std::numeric_limits<float>::max_digits10})
+        {
+            std::ostringstream stream;
+            stream.imbue(std::locale::classic());
+            stream.precision(precision);
+            stream << value;
+            text = stream.str();
+            if (std::stof(text) == value)
+            {
+                break;
+            }
+        }
+        if (text.find_first_of(".e") == std::string::npos)
+        {
+            text += ".0";
+        }
+        return text;
+    }
+
+    static std::string Vec2(vec2 v)
+    {
+        return "vec2f(" + Literal(v.x) + ", " + Literal(v.y) + ")";
+    }
+
+    static std::string Vec3(vec4 v)
+    {
+        return "vec3f(" + Literal(v.x) + ", " + Literal(v.y) + ", " + Literal(v.z) + ")";
+    }
+
+    static constexpr const char *sdBoxSource = R"(fn sdBox(p: vec2f, b: vec2f) -> f32 {
+    let d = abs(p) - b;
+    return length(max(d, vec2(0.0, 0.0))) + min(max(d.x, d.y), 0.0);
+}
+
+)";
+
+    // b = sqrt(r * r - d * d)
+    static constexpr const char *sdVesicaSource = R"(fn sdVesica(p: vec2f, r: f32, d: f32, b: f32) -> f32 {
+    let p1 = abs(p);
+    if (p1.y - b) * d > p1.x * b {
+        return length(p1 - vec2(0.0, b));
+    }
+    return length(p1 - vec2(-d, 0.0)) - r;
+}
+
+)";
+
+    // ce = 0.5 * (he * he - (ra - rb) * (ra - rb)) / (ra - rb)
+    static constexpr const char *sdEggSource = R"(fn sdEgg(p: vec2f, he: f32, ra: f32, rb: f32, ce: f32) -> f32 {
+    let p1 = vec2(abs(p.x), p.y);
+    if p1.y < 0.0 {
+        return length(p1) - ra;
+    }
+    if p1.y * ce - p1.x * he > he * ce {
+        return length(vec2(p1.x, p1.y - he)) - rb;
+    }
+    return length(vec2(p1.x + ce, p1.y)) - (ce + ra);
+}
+
+)";
+
+    // k = 0.5 * (h + 1 / h)
+    static constexpr const char *sdRoundedCrossSource = R"(fn sdRoundedCross(p: vec2f, h: f32, k: f32) -> f32 {
+    let p1 = abs(p);
+    if p1.x < 1.0 && p1.y < p1.x * (k - h) + h {
+        let q = p1 - vec2(1.0, k);
+        return k - sqrt(dot(q, q));
+    }
+    let top = p1 - vec2(0.0, h);
+    let right = p1 - vec2(1.0, 0.0);
+    return sqrt(min(dot(top, top), dot(right, right)));
+}
+
+)";
+
+    static constexpr const char *smoothUnionSource = R"(fn smoothUnion(a: f32, b: f32, k: f32, invK: f32) -> f32 {
+    let h = max(k - abs(a - b), 0.0) * invK;
+    return min(a, b) - h * h * k * 0.25;
+}
+
+)";
+
+    static constexpr const char *fullscreenEntryPoints = R"(
+@fragment
+fn fs_main(@location(0) fragUV: vec2f) -> @location(0) vec4f {
+    return vec4f(sceneColor(fragUV), 1.0);
+}
+
+struct VertexOutput {
+  @builtin(position) position: vec4f,
+  @location(0) fragUV: vec2f,
+};
+
+@vertex
+fn vs_main(@builtin(vertex_index) VertexIndex: u32) -> VertexOutput {
+    var pos = array(
+        vec2(-1.0, 3.0),
+        vec2(3.0, -1.0),
+        vec2(-1.0, -1.0)
+    );
+
+    // uv grows upwards
+    var uv = array(
+        vec2(0.0, 2.0),
+        vec2(2.0, 0.0),
+        vec2(0.0, 0.0)
+    );
+
+    var output: VertexOutput;
+    output.position = vec4(pos[VertexIndex], 0.0, 1.0);
+    output.fragUV = uv[VertexIndex];
+    return output;
+}
+)";
+
+    std::vector<SdfNode> nodes;
+    std::vector<SdfLayer> layers;
+};
+
+// The logo of main.wgsl. The shader repeats the emblem with fract, here each
+// visible repetition has its own transforms, and its additions and
+// subtractions of coverage become paint order.
+export SdfScene LogoScene()
+{
+    SdfScene scene;
+    scene.background = vec4(1.0f, 1.0f, 1.0f, 1.0f);
+    const vec4 white = scene.background;
+    const vec4 green = vec4(0.3f, 0.4f, 0.0f, 1.0f);
+    const auto at = [&](float x, float y, SdfNodeId child)
+    { return scene.Translate(vec2(-0.5f) + vec2(x, y), child); };
+
+    // uv = abs(fragUV - 0.5) mirrors the panel into the four quadrants
+    const SdfNodeId panel = scene.Primitive(ShapeType::Box, vec4(0.22f, 0.19f, 0.0f, 0.0f));
+    const SdfNodeId left = scene.Union(at(0.302f, 0.314f, panel), at(0.302f, -0.314f, panel));
+    const SdfNodeId right = scene.Union(at(-0.302f, 0.314f, panel), at(-0.302f, -0.314f, panel));
+    scene.AddLayer(scene.Union(left, right), 0.001f, green);
+
+    const SdfNodeId circle = scene.Primitive(ShapeType::Circle, vec4(0.1f));
+    const SdfNodeId egg = scene.Primitive(ShapeType::Egg, vec4(2.0f, 0.94f, 0.0f, 0.0f));
+    const SdfNodeId cross = scene.Primitive(ShapeType::RoundedCross, vec4(7.0f, 0.085f, 0.0f, 0.0f));
+    const SdfNodeId vesica = scene.Primitive(ShapeType::Vesica, vec4(1.15f, 1.0f, 0.0f, 0.0f));
+    const SdfNodeId bar = scene.Primitive(ShapeType::Box, vec4(0.06f, 0.015f, 0.0f, 0.0f));
+
+    const SdfNodeId sideOut = at(0.01f, 0.13f, scene.Scale(vec2(3.6f), circle));
+    const SdfNodeId sideIn = at(0.042f, 0.094f, scene.Scale(3.1f * vec2(1.0f, 0.7f), circle));
+    const SdfNodeId eggOut = at(0.092f, 0.07f, scene.Scale(25.0f * vec2(1.1f, 0.8f), scene.RotateUV(-2.43f, egg)));
+    const SdfNodeId eggIn = at(0.08f, 0.075f, scene.Scale(60.0f * vec2(0.9f, 0.8f), scene.RotateUV(-2.43f, egg)));
+    const SdfNodeId centerCross = scene.RotateUV(std::numbers::pi_v<float> / 2.0f, at(-0.04f, 0.0f, scene.Scale(10.0f * vec2(0.7f, 1.0f), cross)));
+    const SdfNodeId tailTop = at(0.0f, -0.09f, scene.Scale(vec2(5.0f), vesica));
+    const SdfNodeId tailBottom = at(0.0f, 0.15f, scene.Scale(vec2(12.0f), vesica));
+    const SdfNodeId centerBar = at(0.0f, 0.09f, bar);
+
+    // uv2 = fract((fragUV - 0.5) * vec2(1.7, 1.6)) shows parts of four cells
+    for (const float cx : {-1.0f, 0.0f})
+    {
+        for (const float cy : {-1.0f, 0.0f})
+        {
+            const Affine2 cell = Affine2::Translate(vec2(-0.5f)).Then(Affine2::Scale(vec2(1.7f, 1.6f))).Then(Affine2::Translate(-vec2(cx, cy)));
+            // uv3 = vec2(1 - uv2.x, uv2.y)
+            const Affine2 mirrored = cell.Then({glm::mat2(-1.0f, 0.0f, 0.0f, 1.0f), vec2(1.0f, 0.0f)});
+            const auto sides = [&](SdfNodeId node)
+            { return scene.Union(scene.Transform(cell, node), scene.Transform(mirrored, node)); };
+
+            scene.AddLayer(sides(sideOut), 0.01f, white);
+            scene.AddLayer(sides(sideIn), 0.005f, green);
+            scene.AddLayer(sides(eggOut), 0.07f, white);
+            scene.AddLayer(sides(eggIn), 0.12f, green);
+            scene.AddLayer(scene.Transform(cell, centerCross), 0.02f, white);
+            scene.AddLayer(scene.Transform(cell, tailTop), 0.01f, white);
+            scene.AddLayer(scene.Transform(cell, tailBottom), 0.02f, white);
+            scene.AddLayer(scene.Transform(cell, centerBar), 0.001f, white);
+        }
+    }
+    return scene;
+}
@@ -0,0 +1,330 @@
+module;
+
+#include <webgpu/webgpu.hpp>
+
+export module shape_renderer;
+
+import <algorithm>;
+import <cstdint>;
+import <span>;
+import <string>;
+
+import loader;
+import resources;
+import shapes;
+
+using namespace wgpu;
+
+struct ShapeParams
+{
+    uint32_t size[2];
+    uint32_t tiles[2];
+    uint32_t shapeCount;
+    uint32_t maxPerTile;
+    uint32_t pad[2];
+    vec4 background;
+};
+
+static_assert(sizeof(ShapeParams) == 48);
+
+// Draws 2D SDF shapes (see shapes.wgsl) in two passes. A compute pass lists
+// for every 16x16 pixel tile the shapes whose bounds touch it, then a
+// fullscreen pass evaluates per pixel only the shapes of its tile, so the cost
+// follows how many shapes overlap locally rather than how many there are.
+// Tiles keep at most maxShapesPerTile shapes, the ones painted last are
+// dropped beyond that.
+export class ShapeRenderer
+{
+public:
+    static constexpr uint32_t tileSize = 16;
+    static constexpr uint32_t maxShapesPerTile = 31;
+
+    explicit ShapeRenderer(ResourceRegistry &inResources) : resources(inResources) {};
+
+    ShapeRenderer(const ShapeRenderer &) = delete;
+    ShapeRenderer &operator=(const ShapeRenderer &) = delete;
+
+    // Builds the pipelines, again on shader reload
+    void Initialize(Device &inDevice, Queue &inQueue, const std::string &source, TextureFormat format)
+    {
+        device = inDevice;
+        queue = inQueue;
+        ReleasePipelines();
+
+        if (!paramsBuffer)
+        {
+            BufferDescriptor bufferDesc;
+            bufferDesc.label = "Shape params";
+            bufferDesc.size = sizeof(ShapeParams);
+            bufferDesc.usage = BufferUsage::Uniform | BufferUsage::CopyDst;
+            bufferDesc.mappedAtCreation = false;
+            paramsBuffer = resources.CreateBuffer(device, bufferDesc);
+        }
+
+        // Binning writes the tile lists that shading reads, they cannot share
+        // a binding: read_write storage is not allowed in fragment shaders
+        BindGroupLayoutEntry entries[3] = {Default, Default, Default};
+        entries[0].binding = 0;
+        entries[0].visibility = ShaderStage::Compute | ShaderStage::Fragment;
+        entries[0].buffer.type = BufferBindingType::Uniform;
+        entries[0].buffer.minBindingSize = sizeof(ShapeParams);
+        entries[1].binding = 1;
+        entries[1].visibility = ShaderStage::Compute | ShaderStage::Fragment;
+        entries[1].buffer.type = BufferBindingType::ReadOnlyStorage;
+        entries[1].buffer.minBindingSize = sizeof(Shape);
+        entries[2].binding = 2;
+        entries[2].visibility = ShaderStage::Compute;
+        entries[2].buffer.type = BufferBindingType::Storage;
+
+        BindGroupLayoutDescriptor bindGroupLayoutDesc{};
+        bindGroupLayoutDesc.entryCount = 3;
+        bindGroupLayoutDesc.entries = entries;
+        binBindGroupLayout = resources.Add(device.createBindGroupLayout(bindGroupLayoutDesc), 0, "Shape binning bind group layout");
+
+        entries[2].binding = 3;
+        entries[2].visibility = ShaderStage::Fragment;
+        entries[2].buffer.type = BufferBindingType::ReadOnlyStorage;
+        shadeBindGroupLayout = resources.Add(device.createBindGroupLayout(bindGroupLayoutDesc), 0, "Shape shading bind group layout");
+
+        PipelineLayoutDescriptor pipelineLayoutDesc{};
+        WGPUBindGroupLayout binLayouts[1] = {resources.Get(binBindGroupLayout)};
+        pipelineLayoutDesc.bindGroupLayoutCount = 1;
+        pipelineLayoutDesc.bindGroupLayouts = binLayouts;
+        binLayout = resources.Add(device.createPipelineLayout(pipelineLayoutDesc), 0, "Shape binning pipeline layout");
+
+        WGPUBindGroupLayout shadeLayouts[1] = {resources.Get(shadeBindGroupLayout)};
+        pipelineLayoutDesc.bindGroupLayouts = shadeLayouts;
+        shadeLayout = resources.Add(device.createPipelineLayout(pipelineLayoutDesc), 0, "Shape shading pipeline layout");
+
+        ShaderModuleDescriptor shaderDesc;
+
+#ifdef WEBGPU_BACKEND_WGPU
+        shaderDesc.hintCount = 0;
+        shaderDesc.hints = nullptr;
+#endif
+
+        ShaderModuleWGSLDescriptor shaderCodeDesc{};
+        shaderCodeDesc.chain.next = nullptr;
+        shaderCodeDesc.chain.sType = SType::ShaderModuleWGSLDescriptor;
+        shaderDesc.nextInChain = &shaderCodeDesc.chain;
+        shaderCodeDesc.code = source.c_str();
+        ShaderModule shaderModule = device.createShaderModule(shaderDesc);
+
+        ComputePipelineDescriptor computeDesc;
+        computeDesc.compute.module = shaderModule;
+        computeDesc.compute.entryPoint = "cs_bin";
+        computeDesc.compute.constantCount = 0;
+        computeDesc.compute.constants = nullptr;
+        computeDesc.layout = resources.Get(binLayout);
+        binPipeline = resources.Add(device.createComputePipeline(computeDesc), 0, "Shape binning pipeline");
+
+        RenderPipelineDescriptor pipelineDesc;
+
+        pipelineDesc.vertex.bufferCount = 0;
+        pipelineDesc.vertex.buffers = nullptr;
+        pipelineDesc.vertex.module = shaderModule;
+        pipelineDesc.vertex.entryPoint = "vs_main";
+        pipelineDesc.vertex.constantCount = 0;
+        pipelineDesc.vertex.constants = nullptr;
+
+        pipelineDesc.primitive.topology = PrimitiveTopology::TriangleList;
+        pipelineDesc.primitive.stripIndexFormat = IndexFormat::Undefined;
+        pipelineDesc.primitive.frontFace = FrontFace::CCW;
+        pipelineDesc.primitive.cullMode = CullMode::None;
+
+        ColorTargetState colorTarget;
+        colorTarget.format = format;
+        colorTarget.blend = nullptr;
+        colorTarget.writeMask = ColorWriteMask::All;
+
+        FragmentState fragmentState;
+        fragmentState.module = shaderModule;
+        fragmentState.entryPoint = "fs_main";
+        fragmentState.constantCount = 0;
+        fragmentState.constants = nullptr;
+        fragmentState.targetCount = 1;
+        fragmentState.targets = &colorTarget;
+        pipelineDesc.fragment = &fragmentState;
+
+        pipelineDesc.depthStencil = nullptr;
+
+        pipelineDesc.multisample.count = 1;
+        pipelineDesc.multisample.mask = ~0u;
+        pipelineDesc.multisample.alphaToCoverageEnabled = false;
+
+        pipelineDesc.layout = resources.Get(shadeLayout);
+        shadePipeline = resources.Add(device.createRenderPipeline(pipelineDesc), 0, "Shape shading pipeline");
+
+        shaderModule.release();
+    }
+
+    // Shapes in paint order, copied to the GPU right away
+    void SetShapes(std::span<const Shape> shapes, vec4 inBackground)
+    {
+        background = inBackground;
+        shapeCount = static_cast<uint32_t>(shapes.size());
+
+        // Bindings cannot be empty, keep room for one shape
+        const uint64_t size = std::max<uint64_t>(shapes.size(), 1) * sizeof(Shape);
+        if (!shapeBuffer || size > shapeCapacity)
+        {
+            resources.Release(shapeBuffer);
+            resources.Release(binBindGroup);
+            resources.Release(shadeBindGroup);
+
+            BufferDescriptor bufferDesc;
+            bufferDesc.label = "Shapes";
+            bufferDesc.size = size;
+            bufferDesc.usage = BufferUsage::Storage | BufferUsage::CopyDst;
+            bufferDesc.mappedAtCreation = false;
+            shapeBuffer = resources.CreateBuffer(device, bufferDesc);
+            shapeCapacity = size;
+        }
+
+        if (!shapes.empty())
+        {
+            queue.writeBuffer(resources.Get(shapeBuffer), 0, shapes.data(), shapes.size() * sizeof(Shape));
+        }
+    }
+
+    // Bins the shapes for a target of this size and draws them over all of it
+    void Draw(CommandEncoder &encoder, TextureView target, uint32_t width, uint32_t height)
+    {
+        if (!binPipeline || !shadePipeline || !shapeBuffer)
+        {
+            return;
+        }
+
+        const uint32_t tilesX = (width + tileSize - 1) / tileSize;
+        const uint32_t tilesY = (height + tileSize - 1) / tileSize;
+        const uint64_t tileBytes = static_cast<uint64_t>(tilesX) * tilesY * (maxShapesPerTile + 1) * sizeof(uint32_t);
+        if (!tileBuffer || tileBytes > tileCapacity)
+        {
+            // Frames still on the GPU may read the old one
+            resources.Release(tileBuffer);
+            resources.Release(binBindGroup);
+            resources.Release(shadeBindGroup);
+
+            BufferDescriptor bufferDesc;
+            bufferDesc.label = "Shape tiles";
+            bufferDesc.size = tileBytes;
+            bufferDesc.usage = BufferUsage::Storage;
+            bufferDesc.mappedAtCreation = false;
+            tileBuffer = resources.CreateBuffer(device, bufferDesc);
+            tileCapacity = tileBytes;
+        }
+
+        if (!binBindGroup || !shadeBindGroup)
+        {
+            CreateBindGroups();
+        }
+
+        const ShapeParams params = {{width, height}, {tilesX, tilesY}, shapeCount, maxShapesPerTile, {0, 0}, background};
+        queue.writeBuffer(resources.Get(paramsBuffer), 0, &params, sizeof(params));
+
+        ComputePassDescriptor computePassDesc;
+        computePassDesc.timestampWrites = nullptr;
+        ComputePassEncoder computePass = encoder.beginComputePass(computePassDesc);
+        computePass.setPipeline(resources.Get(binPipeline));
+        computePass.setBindGroup(0, resources.Get(binBindGroup), 0, nullptr);
+        // Workgroups of 8x8 tiles
+        computePass.dispatchWorkgroups((tilesX + 7) / 8, (tilesY + 7) / 8, 1);
+        computePass.end();
+        computePass.release();
+
+        RenderPassColorAttachment colorAttachment = {};
+        colorAttachment.view = target;
+        colorAttachment.resolveTarget = nullptr;
+        // Every pixel is overwritten
+        colorAttachment.loadOp = LoadOp::Clear;
+        colorAttachment.storeOp = StoreOp::Store;
+        colorAttachment.clearValue = WGPUColor{0.0, 0.0, 0.0, 1.0};
+#ifndef WEBGPU_BACKEND_WGPU
+        colorAttachment.depthSlice = WGPU_DEPTH_SLICE_UNDEFINED;
+#endif // NOT WEBGPU_BACKEND_WGPU
+
+        RenderPassDescriptor passDesc = {};
+        passDesc.colorAttachmentCount = 1;
+        passDesc.colorAttachments = &colorAttachment;
+        passDesc.depthStencilAttachment = nullptr;
+        passDesc.timestampWrites = nullptr;
+
+        RenderPassEncoder pass = encoder.beginRenderPass(passDesc);
+        pass.setPipeline(resources.Get(shadePipeline));
+        pass.setBindGroup(0, resources.Get(shadeBindGroup), 0, nullptr);
+        pass.draw(3, 1, 0, 0);
+        pass.end();
+        pass.release();
+    }
+
+    void Terminate()
+    {
+        ReleasePipelines();
+        resources.Release(paramsBuffer);
+        resources.Release(shapeBuffer);
+        resources.Release(tileBuffer);
+    }
+
+private:
+    void CreateBindGroups()
+    {
+        resources.Release(binBindGroup);
+        resources.Release(shadeBindGroup);
+
+        BindGroupEntry bindings[3] = {};
+        bindings[0].binding = 0;
+        bindings[0].buffer = resources.Get(paramsBuffer);
+        bindings[0].offset = 0;
+        bindings[0].size = sizeof(ShapeParams);
+        bindings[1].binding = 1;
+        bindings[1].buffer = resources.Get(shapeBuffer);
+        bindings[1].offset = 0;
+        bindings[1].size = shapeCapacity;
+        bindings[2].binding = 2;
+        bindings[2].buffer = resources.Get(tileBuffer);
+        bindings[2].offset = 0;
+        bindings[2].size = tileCapacity;
+
+        BindGroupDescriptor bindGroupDesc{};
+        bindGroupDesc.layout = resources.Get(binBindGroupLayout);
+        bindGroupDesc.entryCount = 3;
+        bindGroupDesc.entries = bindings;
+        binBindGroup = resources.Add(device.createBindGroup(bindGroupDesc), 0, "Shape binning bind group");
+
+        bindings[2].binding = 3;
+        bindGroupDesc.layout = resources.Get(shadeBindGroupLayout);
+        shadeBindGroup = resources.Add(device.createBindGroup(bindGroupDesc), 0, "Shape shading bind group");
+    }
+
+    // Bind groups go too, they refer to the layouts
+    void ReleasePipelines()
+    {
+        resources.Release(binBindGroup);
+        resources.Release(shadeBindGroup);
+        resources.Release(binPipeline);
+        resources.Release(shadePipeline);
+        resources.Release(binLayout);
+        resources.Release(shadeLayout);
+        resources.Release(binBindGroupLayout);
+        resources.Release(shadeBindGroupLayout);
+    }
+
+    ResourceRegistry &resources;
+    Device device;
+    Queue queue;
+    Handle<BindGroupLayout> binBindGroupLayout;
+    Handle<BindGroupLayout> shadeBindGroupLayout;
+    Handle<PipelineLayout> binLayout;
+    Handle<PipelineLayout> shadeLayout;
+    Handle<ComputePipeline> binPipeline;
+    Handle<RenderPipeline> shadePipeline;
+    Handle<BindGroup> binBindGroup;
+    Handle<BindGroup> shadeBindGroup;
+    Handle<Buffer> paramsBuffer;
+    Handle<Buffer> shapeBuffer;
+    Handle<Buffer> tileBuffer;
+    uint64_t shapeCapacity = 0;
+    uint64_t tileCapacity = 0;
+    uint32_t shapeCount = 0;
+    vec4 background = vec4(1.0f);
+};
@@ -0,0 +1,135 @@
+export module shapes;
+
+import <algorithm>;
+import <cmath>;
+import <cstdint>;
+import <limits>;
+
+import loader;
+
+// Maps p to m * p + t
+export struct Affine2
+{
+    glm::mat2 m = glm::mat2(1.0f);
+    vec2 t = vec2(0.0f);
+
+    vec2 Apply(vec2 p) const
+    {
+        return m * p + t;
+    }
+
+    // This transform, then next
+    Affine2 Then(const Affine2 &next) const
+    {
+        return {next.m * m, next.m * t + next.t};
+    }
+
+    Affine2 Inverse() const
+    {
+        const glm::mat2 inverse = glm::inverse(m);
+        return {inverse, -(inverse * t)};
+    }
+
+    static Affine2 Translate(vec2 offset)
+    {
+        return {glm::mat2(1.0f), offset};
+    }
+
+    static Affine2 Scale(vec2 scale)
+    {
+        return {glm::mat2(scale.x, 0.0f, 0.0f, scale.y), vec2(0.0f)};
+    }
+
+    // rotateUV of the shaders: turns by -angle around (0.5, 0.5)
+    static Affine2 RotateUV(float angle)
+    {
+        const float c = std::cos(angle);
+        const float s = std::sin(angle);
+        return Translate(vec2(-0.5f)).Then({glm::mat2(c, -s, s, c), vec2(0.0f)}).Then(Translate(vec2(0.5f)));
+    }
+};
+
+export enum class ShapeType : uint32_t
+{
+    // params: half size xy
+    Box,
+    // params: radius
+    Circle,
+    // params: radius, distance of the circles from the center
+    Vesica,
+    // params: height, bottom radius, top radius
+    Egg,
+    // params: height, rounding subtracted from the distance
+    RoundedCross,
+};
+
+// One shape as the GPU reads it, see Shape in shapes.wgsl. Coverage is
+// 1 - smoothstep(0, edge, distance) at transform * uv + offset, painted over
+// what is below with color.a.
+export struct Shape
+{
+    // Columns of the 2x2 part of uv to shape space
+    vec4 transform;
+    vec2 offset;
+    ShapeType type;
+    float edge;
+    vec4 params;
+    // Conservative uv bounds of the covered area, min in xy, max in zw
+    vec4 bounds;
+    vec4 color;
+};
+
+static_assert(sizeof(Shape) == 80);
+
+export Shape MakeShape(ShapeType type, vec4 params, const Affine2 &uvToShape, float edge, vec4 color)
+{
+    Shape shape;
+    shape.transform = vec4(uvToShape.m[0], uvToShape.m[1]);
+    shape.offset = uvToShape.t;
+    shape.type = type;
+    shape.edge = edge;
+    shape.params = params;
+    shape.color = color;
+
+    // Box around everything closer than edge, in shape space
+    vec2 low(0.0f);
+    vec2 high(0.0f);
+    switch (type)
+    {
+    case ShapeType::Box:
+        high = vec2(params.x, params.y);
+        break;
+    case ShapeType::Circle:
+        high = vec2(params.x);
+        break;
+    case ShapeType::Vesica:
+        high = vec2(params.x - params.y, std::sqrt(std::max(params.x * params.x - params.y * params.y, 0.0f)));
+        break;
+    case ShapeType::Egg:
+        high = vec2(std::max(params.y, params.z), params.x + params.z);
+        low = vec2(-high.x, -params.y);
+        break;
+    case ShapeType::RoundedCross:
+        high = vec2(1.0f + params.y, params.x + params.y);
+        break;
+    }
+    if (type != ShapeType::Egg)
+    {
+        low = -high;
+    }
+    low -= vec2(edge);
+    high += vec2(edge);
+
+    // The corners in uv bound the parallelogram the box maps to
+    const Affine2 shapeToUv = uvToShape.Inverse();
+    vec2 minimum(std::numeric_limits<float>::max());
+    vec2 maximum(std::numeric_limits<float>::lowest());
+    for (const vec2 corner : {low, vec2(high.x, low.y), vec2(low.x, high.y), high})
+    {
+        const vec2 uv = shapeToUv.Apply(corner);
+        minimum = glm::min(minimum, uv);
+        maximum = glm::max(maximum, uv);
+    }
+    shape.bounds = vec4(minimum, maximum);
+    return shape;
+}
@@ -0,0 +1,417 @@
+export module simplify;
+
+import <algorithm>;
+import <cmath>;
+import <cstdint>;
+import <cstring>;
+import <limits>;
+import <span>;
+import <unordered_map>;
+import <vector>;
+
+import loader;
+import meshlets;
+
+// Symmetric 4x4 matrix measuring the summed squared distance to a set of
+// planes (Garland & Heckbert), weighted by triangle area.
+struct Quadric
+{
+    double a00 = 0, a01 = 0, a02 = 0, a03 = 0;
+    double a11 = 0, a12 = 0, a13 = 0;
+    double a22 = 0, a23 = 0;
+    double a33 = 0;
+    double weight = 0;
+
+    static Quadric FromPlane(double a, double b, double c, double d, double weight)
+    {
+        Quadric q;
+        q.a00 = a * a * weight, q.a01 = a * b * weight, q.a02 = a * c * weight, q.a03 = a * d * weight;
+        q.a11 = b * b * weight, q.a12 = b * c * weight, q.a13 = b * d * weight;
+        q.a22 = c * c * weight, q.a23 = c * d * weight;
+        q.a33 = d * d * weight;
+        q.weight = weight;
+        return q;
+    }
+
+    Quadric &operator+=(const Quadric &o)
+    {
+        a00 += o.a00, a01 += o.a01, a02 += o.a02, a03 += o.a03;
+        a11 += o.a11, a12 += o.a12, a13 += o.a13;
+        a22 += o.a22, a23 += o.a23;
+        a33 += o.a33;
+        weight += o.weight;
+        return *this;
+    }
+
+    // Mean squared distance of p to the planes
+    double Error(const vec3 &p) const
+    {
+        const double x = p.x, y = p.y, z = p.z;
+        const double error = a00 * x * x + 2 * a01 * x * y + 2 * a02 * x * z + 2 * a03 * x +
+                             a11 * y * y + 2 * a12 * y * z + 2 * a13 * y +
+                             a22 * z * z + 2 * a23 * z +
+                             a33;
+        return weight > 0 ? std::max(error, 0.0) / weight : 0.0;
+    }
+};
+
+enum class VertexKind : uint8_t
+{
+    Manifold,
+    Border,
+    // Shares its position with other vertices (normal/uv seam), never moves
+    Locked
+};
+
+struct Collapse
+{
+    uint32_t from;
+    uint32_t to;
+    double cost;
+};
+
+uint64_t EdgeKey(uint32_t a, uint32_t b)
+{
+    return a < b ? (uint64_t(a) << 32 | b) : (uint64_t(b) << 32 | a);
+}
+
+// Edge collapse simplification towards targetIndexCount. Vertices are only ever
+// merged into existing ones, so the result indexes the same vertex buffer.
+// Stops early once a collapse would move the surface further than maxError.
+// error receives the largest deviation (object space) that was accepted.
+export std::vector<uint32_t> SimplifyMesh(std::span<const Loader::VertexAttributes> vertices, std::span<const uint32_t> inIndices,
+                                          size_t targetIndexCount, float maxError, float &error)
+{
+    std::vector<uint32_t> indices(inIndices.begin(), inIndices.end());
+    error = 0.0f;
+
+    const uint32_t vertexCount = static_cast<uint32_t>(vertices.size());
+    const auto position = [&](uint32_t v) -> const vec3 &
+    {
+        return vertices[v].position;
+    };
+
+    // Vertices split only by attributes share a position
+    std::vector<uint32_t> canonical(vertexCount);
+    std::vector<VertexKind> kind(vertexCount, VertexKind::Manifold);
+    {
+        struct PositionHash
+        {
+            size_t operator()(const vec3 &p) const
+            {
+                uint32_t bits[3];
+                std::memcpy(&bits[0], &p.x, 4);
+                std::memcpy(&bits[1], &p.y, 4);
+                std::memcpy(&bits[2], &p.z, 4);
+                return (size_t(bits[0]) * 73856093u) ^ (size_t(bits[1]) * 19349663u) ^ (size_t(bits[2]) * 83492791u);
+            }
+        };
+        struct PositionEqual
+        {
+            bool operator()(const vec3 &a, const vec3 &b) const
+            {
+                return a.x == b.x && a.y == b.y && a.z == b.z;
+            }
+        };
+
+        std::unordered_map<vec3, uint32_t, PositionHash, PositionEqual> firstAt;
+        firstAt.reserve(vertexCount);
+        for (uint32_t v = 0; v < vertexCount; ++v)
+        {
+            auto [it, inserted] = firstAt.try_emplace(position(v), v);
+            canonical[v] = it->second;
+            if (!inserted)
+            {
+                kind[v] = VertexKind::Locked;
+                kind[it->second] = VertexKind::Locked;
+            }
+        }
+    }
+
+    // Edges used by a single triangle are on an open border
+    std::unordered_map<uint64_t, uint32_t> edgeUse;
+    const auto isBorderEdge = [&](uint32_t a, uint32_t b)
+    {
+        auto it = edgeUse.find(EdgeKey(canonical[a], canonical[b]));
+        return it != edgeUse.end() && it->second == 1;
+    };
+    for (size_t i = 0; i < indices.size(); i += 3)
+    {
+        for (uint32_t k = 0; k < 3; ++k)
+        {
+            edgeUse[EdgeKey(canonical[indices[i + k]], canonical[indices[i + (k + 1) % 3]])]++;
+        }
+    }
+
+    std::vector<Quadric> quadrics(vertexCount);
+    for (size_t i = 0; i < indices.size(); i += 3)
+    {
+        const uint32_t v[3] = {indices[i], indices[i + 1], indices[i + 2]};
+        const vec3 normal = glm::cross(position(v[1]) - position(v[0]), position(v[2]) - position(v[0]));
+        const double area = glm::length(normal);
+        if (area <= 0.0)
+        {
+            continue;
+        }
+
+        const vec3 n = normal / static_cast<float>(area);
+        const Quadric plane = Quadric::FromPlane(n.x, n.y, n.z, -glm::dot(n, position(v[0])), area);
+        for (uint32_t k = 0; k < 3; ++k)
+        {
+            quadrics[canonical[v[k]]] += plane;
+        }
+
+        // Border edges get a steep plane through them so the outline stays put
+        for (uint32_t k = 0; k < 3; ++k)
+        {
+            const uint32_t a = v[k];
+            const uint32_t b = v[(k + 1) % 3];
+            if (!isBorderEdge(a, b))
+            {
+                continue;
+            }
+
+            const vec3 edge = position(b) - position(a);
+            const float length = glm::length(edge);
+            if (length <= 0.0f)
+            {
+                continue;
+            }
+            const vec3 side = glm::normalize(glm::cross(edge, n));
+            const Quadric border = Quadric::FromPlane(side.x, side.y, side.z, -glm::dot(side, position(a)), 10.0 * length * length);
+            quadrics[canonical[a]] += border;
+            quadrics[canonical[b]] += border;
+            if (kind[a] == VertexKind::Manifold)
+            {
+                kind[a] = VertexKind::Border;
+            }
+            if (kind[b] == VertexKind::Manifold)
+            {
+                kind[b] = VertexKind::Border;
+            }
+        }
+    }
+
+    const double maxCost = double(maxError) * double(maxError);
+    double acceptedCost = 0.0;
+
+    std::vector<uint32_t> remap(vertexCount);
+    std::vector<bool> touched(vertexCount);
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1);
+    std::vector<uint32_t> adjacency;
+    std::vector<Collapse> collapses;
+
+    // Each pass collapses the cheapest edges whose neighbourhoods do not
+    // overlap, then compacts the index buffer
+    while (indices.size() > targetIndexCount)
+    {
+        const size_t triangleCount = indices.size() / 3;
+
+        std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+        for (uint32_t index : indices)
+        {
+            adjacencyOffsets[index + 1]++;
+        }
+        for (uint32_t v = 0; v < vertexCount; ++v)
+        {
+            adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+        }
+        adjacency.resize(indices.size());
+        {
+            std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+            for (uint32_t i = 0; i < indices.size(); ++i)
+            {
+                adjacency[fill[indices[i]]++] = i / 3;
+            }
+        }
+
+        const auto canCollapse = [&](uint32_t from, uint32_t to)
+        {
+            if (kind[from] == VertexKind::Locked || kind[to] == VertexKind::Locked)
+            {
+                return false;
+            }
+            // Border vertices only slide along the border
+            return kind[from] != VertexKind::Border || (kind[to] == VertexKind::Border && isBorderEdge(from, to));
+        };
+
+        collapses.clear();
+        for (size_t i = 0; i < indices.size(); i += 3)
+        {
+            for (uint32_t k = 0; k < 3; ++k)
+            {
+                const uint32_t a = indices[i + k];
+                const uint32_t b = indices[i + (k + 1) % 3];
+                // Interior edges show up twice, keep one
+                if (a > b && !isBorderEdge(a, b))
+                {
+                    continue;
+                }
+
+                Quadric merged = quadrics[a];
+                merged += quadrics[b];
+                const double costAB = canCollapse(a, b) ? merged.Error(position(b)) : std::numeric_limits<double>::infinity();
+                const double costBA = canCollapse(b, a) ? merged.Error(position(a)) : std::numeric_limits<double>::infinity();
+                if (std::isinf(costAB) && std::isinf(costBA))
+                {
+                    continue;
+                }
+                collapses.push_back(costAB <= costBA ? Collapse{a, b, costAB} : Collapse{b, a, costBA});
+            }
+        }
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse &x, const Collapse &y)
+                  { return x.cost < y.cost; });
+
+        for (uint32_t v = 0; v < vertexCount; ++v)
+        {
+            remap[v] = v;
+        }
+        std::fill(touched.begin(), touched.end(), false);
+
+        // Every collapse removes about two triangles
+        const size_t wanted = (triangleCount - targetIndexCount / 3 + 1) / 2;
+        size_t done = 0;
+        for (const Collapse &collapse : collapses)
+        {
+            if (done >= wanted || collapse.cost > maxCost)
+            {
+                break;
+            }
+            if (touched[collapse.from] || touched[collapse.to])
+            {
+                continue;
+            }
+
+            // Moving the vertex must not fold any remaining triangle over
+            bool flips = false;
+            for (uint32_t a = adjacencyOffsets[collapse.from]; a < adjacencyOffsets[collapse.from + 1] && !flips; ++a)
+            {
+                const uint32_t *triangle = &indices[adjacency[a] * 3];
+                if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to)
+                {
+                    continue;
+                }
+
+                vec3 p[3];
+                vec3 q[3];
+                for (uint32_t k = 0; k < 3; ++k)
+                {
+                    p[k] = position(triangle[k]);
+                    q[k] = triangle[k] == collapse.from ? position(collapse.to) : p[k];
+                }
+                const vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+                const vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+                flips = glm::dot(before, after) <= 0.0f;
+            }
+            if (flips)
+            {
+                continue;
+            }
+
+            remap[collapse.from] = collapse.to;
+            quadrics[collapse.to] += quadrics[collapse.from];
+            acceptedCost = std::max(acceptedCost, collapse.cost);
+            done++;
+
+            for (uint32_t vertex : {collapse.from, collapse.to})
+            {
+                for (uint32_t a = adjacencyOffsets[vertex]; a < adjacencyOffsets[vertex + 1]; ++a)
+                {
+                    const uint32_t *triangle = &indices[adjacency[a] * 3];
+                    touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = true;
+                }
+            }
+        }
+
+        if (done == 0)
+        {
+            break;
+        }
+
+        size_t kept = 0;
+        for (size_t i = 0; i < indices.size(); i += 3)
+        {
+            const uint32_t a = remap[indices[i]];
+            const uint32_t b = remap[indices[i + 1]];
+            const uint32_t c = remap[indices[i + 2]];
+            if (a != b && b != c && a != c)
+            {
+                indices[kept++] = a;
+                indices[kept++] = b;
+                indices[kept++] = c;
+            }
+        }
+        indices.resize(kept);
+
+        // Border flags follow the surviving edges
+        edgeUse.clear();
+        for (size_t i = 0; i < indices.size(); i += 3)
+        {
+            for (uint32_t k = 0; k < 3; ++k)
+            {
+                edgeUse[EdgeKey(canonical[indices[i + k]], canonical[indices[i + (k + 1) % 3]])]++;
+            }
+        }
+    }
+
+    error = static_cast<float>(std::sqrt(acceptedCost));
+    return indices;
+}
+
+// Replaces the mesh's indices by a chain of LODs each with about half the
+// triangles of the previous one, builds meshlets per LOD and records the LOD
+// table. Errors accumulate along the chain so they bound the deviation from
+// the full mesh.
+export void BuildLods(Loader::Mesh &mesh, uint32_t maxLods = 5, uint32_t minTriangles = 128)
+{
+    std::vector<std::vector<uint32_t>> levels;
+    std::vector<float> errors;
+    levels.push_back(mesh.indices);
+    errors.push_back(0.0f);
+
+    while (levels.size() < maxLods && levels.back().size() / 3 >= minTriangles * 2)
+    {
+        float error = 0.0f;
+        std::vector<uint32_t> simplified = SimplifyMesh(mesh.vertices, levels.back(), levels.back().size() / 2, std::numeric_limits<float>::max(), error);
+
+        // Locked seams or borders can stall the simplifier
+        if (simplified.size() > levels.back().size() * 9 / 10)
+        {
+            break;
+        }
+        errors.push_back(errors.back() + error);
+        levels.push_back(std::move(simplified));
+    }
+
+    std::vector<vec3> points(mesh.vertices.size());
+    for (size_t v = 0; v < points.size(); ++v)
+    {
+        points[v] = mesh.vertices[v].position;
+    }
+    const vec4 sphere = BoundingSphere(points);
+
+    mesh.indices.clear();
+    mesh.meshlets.clear();
+    mesh.lods.clear();
+    for (size_t level = 0; level < levels.size(); ++level)
+    {
+        std::vector<Loader::Meshlet> meshlets;
+        BuildMeshlets(mesh.vertices, levels[level], meshlets);
+
+        Loader::MeshLod lod;
+        lod.sphere = sphere;
+        lod.firstIndex = static_cast<uint32_t>(mesh.indices.size());
+        lod.indexCount = static_cast<uint32_t>(levels[level].size());
+        lod.firstMeshlet = static_cast<uint32_t>(mesh.meshlets.size());
+        lod.meshletCount = static_cast<uint32_t>(meshlets.size());
+        lod.error = errors[level];
+        mesh.lods.push_back(lod);
+
+        for (Loader::Meshlet &meshlet : meshlets)
+        {
+            meshlet.firstIndex += lod.firstIndex;
+        }
+        mesh.meshlets.insert(mesh.meshlets.end(), meshlets.begin(), meshlets.end());
+        mesh.indices.insert(mesh.indices.end(), levels[level].begin(), levels[level].end());
+    }
+}
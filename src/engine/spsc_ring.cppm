@@ -0,0 +1,92 @@
+export module spsc_ring;
+
+import <array>;
+import <atomic>;
+import <cstddef>;
+
+// Fixed-size lock-free ring for exactly one producer and one consumer thread.
+// Capacity must be a power of two, one slot is never used to tell full from
+// empty apart.
+export template <typename T, size_t Capacity>
+class SpscRing
+{
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "SpscRing capacity must be a power of two");
+
+public:
+    SpscRing() = default;
+
+    SpscRing(const SpscRing &) = delete;
+    SpscRing &operator=(const SpscRing &) = delete;
+
+    // Producer side, false when the ring is full
+    bool TryPush(const T &item)
+    {
+        const size_t tail = this->tail.load(std::memory_order_relaxed);
+        const size_t next = (tail + 1) & mask;
+        if (next == cachedHead)
+        {
+            cachedHead = head.load(std::memory_order_acquire);
+            if (next == cachedHead)
+            {
+                return false;
+            }
+        }
+
+        items[tail] = item;
+        this->tail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side, the oldest item or nullptr when empty. Stays valid until Pop.
+    const T *Front()
+    {
+        const size_t head = this->head.load(std::memory_order_relaxed);
+        if (head == cachedTail)
+        {
+            cachedTail = tail.load(std::memory_order_acquire);
+            if (head == cachedTail)
+            {
+                return nullptr;
+            }
+        }
+        return &items[head];
+    }
+
+    // Consumer side, only after Front returned an item
+    void Pop()
+    {
+        const size_t head = this->head.load(std::memory_order_relaxed);
+        this->head.store((head + 1) & mask, std::memory_order_release);
+    }
+
+    bool TryPop(T &item)
+    {
+        const T *front = Front();
+        if (!front)
+        {
+            return false;
+        }
+        item = *front;
+        Pop();
+        return true;
+    }
+
+    // Approximate from any thread other than the two ends
+    size_t Size() const
+    {
+        return (tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire)) & mask;
+    }
+
+    static constexpr size_t capacity = Capacity - 1;
+
+private:
+    static constexpr size_t mask = Capacity - 1;
+    static constexpr size_t cacheLine = 64;
+
+    // Each end owns a cache line, with its cached copy of the other end's index
+    alignas(cacheLine) std::atomic<size_t> head = 0;
+    size_t cachedTail = 0;
+    alignas(cacheLine) std::atomic<size_t> tail = 0;
+    size_t cachedHead = 0;
+    alignas(cacheLine) std::array<T, Capacity> items;
+};
@@ -0,0 +1,334 @@
+module;
+
+#include <webgpu/webgpu.hpp>
+
+export module staging_belt;
+
+import <atomic>;
+import <cstddef>;
+import <cstdint>;
+import <memory>;
+import <mutex>;
+import <vector>;
+
+import buffer_pool;
+import release_queue;
+
+using namespace wgpu;
+
+class StagingChunk;
+
+// Memory handed to a producer. It stays valid until Commit, after which the
+// next Flush copies it into the destination range.
+export struct StagingWrite
+{
+    std::byte *data = nullptr;
+    uint64_t size = 0;
+    BufferRange destination;
+    uint64_t destinationOffset = 0;
+    uint64_t sourceOffset = 0;
+    StagingChunk *chunk = nullptr;
+
+    explicit operator bool() const
+    {
+        return data != nullptr;
+    }
+};
+
+export struct StagingStats
+{
+    uint32_t chunks;
+    uint64_t capacity;
+    uint64_t flushedLastFrame;
+    uint64_t flushedTotal;
+};
+
+class StagingChunk
+{
+public:
+    enum class State
+    {
+        Open,
+        InFlight,
+        Mapping,
+        Free
+    };
+
+    struct Copy
+    {
+        uint64_t sourceOffset;
+        BufferRange destination;
+        uint64_t destinationOffset;
+        uint64_t size;
+        std::atomic<uint32_t> *pendingCopies;
+    };
+
+    Buffer buffer = nullptr;
+    std::byte *mapped = nullptr;
+    uint64_t capacity = 0;
+    uint64_t cursor = 0;
+    uint32_t outstanding = 0;
+    bool dedicated = false;
+    State state = State::Open;
+    std::vector<Copy> copies;
+    std::unique_ptr<BufferMapCallback> mapping;
+};
+
+// Ring of upload buffers that stay mapped while producers (from any thread)
+// write vertex or index data straight into them. Once per frame the main thread
+// turns the committed writes into copyBufferToBuffer commands, and after submit
+// the chunks are mapped again asynchronously so they can be reused.
+export class StagingBelt
+{
+public:
+    static constexpr uint64_t defaultChunkSize = 4ull << 20;
+
+    StagingBelt(BufferPool &inBufferPool, ReleaseQueue &inReleaseQueue) : bufferPool(inBufferPool), releaseQueue(inReleaseQueue) {};
+
+    StagingBelt(const StagingBelt &) = delete;
+    StagingBelt &operator=(const StagingBelt &) = delete;
+
+    void Initialize(Device inDevice, uint64_t inChunkSize = defaultChunkSize)
+    {
+        device = inDevice;
+        chunkSize = inChunkSize;
+    }
+
+    // Thread safe. Size must be a multiple of 4 to satisfy copy alignment.
+    StagingWrite Allocate(const BufferRange &destination, uint64_t destinationOffset, uint64_t size)
+    {
+        if (size == 0 || size % 4 != 0)
+        {
+            return {};
+        }
+
+        std::lock_guard lock(mutex);
+
+        if (!current || current->state != StagingChunk::State::Open || current->cursor + size > current->capacity)
+        {
+            current = AcquireChunk(size);
+            if (!current)
+            {
+                return {};
+            }
+        }
+
+        StagingWrite write;
+        write.data = current->mapped + current->cursor;
+        write.size = size;
+        write.destination = destination;
+        write.destinationOffset = destinationOffset;
+        write.sourceOffset = current->cursor;
+        write.chunk = current;
+
+        current->cursor += (size + alignment - 1) / alignment * alignment;
+        current->outstanding++;
+
+        return write;
+    }
+
+    // Thread safe. Marks the written memory as ready to be flushed. The optional
+    // counter is incremented now and decremented once the copy was recorded,
+    // letting the owner know when its data is usable by the following draws.
+    void Commit(StagingWrite &write, std::atomic<uint32_t> *pendingCopies = nullptr)
+    {
+        if (!write)
+        {
+            return;
+        }
+
+        if (pendingCopies)
+        {
+            pendingCopies->fetch_add(1, std::memory_order_relaxed);
+        }
+
+        std::lock_guard lock(mutex);
+        write.chunk->copies.push_back({write.sourceOffset, write.destination, write.destinationOffset, write.size, pendingCopies});
+        write.chunk->outstanding--;
+        write = {};
+    }
+
+    // Thread safe. Gives up a write without copying it, its memory stays unused
+    // until the chunk is recycled.
+    void Abandon(StagingWrite &write)
+    {
+        if (!write)
+        {
+            return;
+        }
+
+        std::lock_guard lock(mutex);
+        write.chunk->outstanding--;
+        write = {};
+    }
+
+    // Records the copies of every chunk that has no write in progress. Chunks
+    // still being filled keep their copies for a later frame since a buffer
+    // cannot be used by the GPU while it is mapped.
+    void Flush(CommandEncoder &encoder)
+    {
+        std::lock_guard lock(mutex);
+
+        flushedLastFrame = 0;
+        for (auto &chunk : chunks)
+        {
+            if (chunk->state != StagingChunk::State::Open || chunk->outstanding > 0 || chunk->copies.empty())
+            {
+                continue;
+            }
+
+            chunk->buffer.unmap();
+            chunk->mapped = nullptr;
+
+            for (const auto &copy : chunk->copies)
+            {
+                encoder.copyBufferToBuffer(chunk->buffer, copy.sourceOffset,
+                                           bufferPool.GetBuffer(copy.destination), bufferPool.Offset(copy.destination) + copy.destinationOffset,
+                                           copy.size);
+                flushedLastFrame += copy.size;
+                if (copy.pendingCopies)
+                {
+                    copy.pendingCopies->fetch_sub(1, std::memory_order_release);
+                }
+            }
+            chunk->copies.clear();
+            chunk->state = StagingChunk::State::InFlight;
+
+            if (current == chunk.get())
+            {
+                current = nullptr;
+            }
+        }
+        flushedTotal += flushedLastFrame;
+    }
+
+    // Call after the encoder passed to Flush was submitted.
+    void Recall()
+    {
+        std::vector<StagingChunk *> submitted;
+        {
+            std::lock_guard lock(mutex);
+
+            for (size_t i = 0; i < chunks.size();)
+            {
+                StagingChunk *chunk = chunks[i].get();
+                if (chunk->state != StagingChunk::State::InFlight)
+                {
+                    ++i;
+                    continue;
+                }
+
+                // Oversized chunks are not worth keeping around
+                if (chunk->dedicated)
+                {
+                    releaseQueue.Retire(chunk->buffer);
+                    chunks.erase(chunks.begin() + i);
+                    continue;
+                }
+
+                chunk->state = StagingChunk::State::Mapping;
+                submitted.push_back(chunk);
+                ++i;
+            }
+        }
+
+        // Outside the lock since a failing mapAsync may call back immediately
+        for (StagingChunk *chunk : submitted)
+        {
+            chunk->mapping = chunk->buffer.mapAsync(MapMode::Write, 0, chunk->capacity, [this, chunk](BufferMapAsyncStatus status)
+                                                    {
+                std::lock_guard lock(mutex);
+                if (status == BufferMapAsyncStatus::Success && chunk->buffer)
+                {
+                    chunk->mapped = static_cast<std::byte *>(chunk->buffer.getMappedRange(0, chunk->capacity));
+                    chunk->cursor = 0;
+                    chunk->state = StagingChunk::State::Free;
+                }
+                else
+                {
+                    // Dropped by the next Recall
+                    chunk->state = StagingChunk::State::InFlight;
+                    chunk->dedicated = true;
+                } });
+        }
+    }
+
+    uint64_t ChunkSize() const
+    {
+        return chunkSize;
+    }
+
+    StagingStats Stats()
+    {
+        std::lock_guard lock(mutex);
+
+        StagingStats stats{static_cast<uint32_t>(chunks.size()), 0, flushedLastFrame, flushedTotal};
+        for (const auto &chunk : chunks)
+        {
+            stats.capacity += chunk->capacity;
+        }
+        return stats;
+    }
+
+    void Terminate()
+    {
+        std::lock_guard lock(mutex);
+
+        // Chunks stay allocated since pending map callbacks still point at them
+        for (auto &chunk : chunks)
+        {
+            releaseQueue.Retire(chunk->buffer);
+            chunk->state = StagingChunk::State::Mapping;
+        }
+        current = nullptr;
+    }
+
+private:
+    static constexpr uint64_t alignment = 16;
+
+    StagingChunk *AcquireChunk(uint64_t size)
+    {
+        if (size <= chunkSize)
+        {
+            for (auto &chunk : chunks)
+            {
+                if (chunk->state == StagingChunk::State::Free)
+                {
+                    chunk->state = StagingChunk::State::Open;
+                    return chunk.get();
+                }
+            }
+        }
+
+        const bool dedicated = size > chunkSize;
+
+        BufferDescriptor bufferDesc;
+        bufferDesc.label = "Staging chunk";
+        bufferDesc.size = dedicated ? (size + alignment - 1) / alignment * alignment : chunkSize;
+        bufferDesc.usage = BufferUsage::MapWrite | BufferUsage::CopySrc;
+        bufferDesc.mappedAtCreation = true;
+
+        auto chunk = std::make_unique<StagingChunk>();
+        chunk->buffer = device.createBuffer(bufferDesc);
+        if (!chunk->buffer)
+        {
+            return nullptr;
+        }
+        chunk->capacity = bufferDesc.size;
+        chunk->mapped = static_cast<std::byte *>(chunk->buffer.getMappedRange(0, chunk->capacity));
+        chunk->dedicated = dedicated;
+
+        chunks.push_back(std::move(chunk));
+        return chunks.back().get();
+    }
+
+    BufferPool &bufferPool;
+    ReleaseQueue &releaseQueue;
+    Device device = nullptr;
+    uint64_t chunkSize = defaultChunkSize;
+    std::mutex mutex;
+    std::vector<std::unique_ptr<StagingChunk>> chunks;
+    StagingChunk *current = nullptr;
+    uint64_t flushedLastFrame = 0;
+    uint64_t flushedTotal = 0;
+};
@@ -0,0 +1,227 @@
+module;
+
+#include <webgpu/webgpu.hpp>
+
+export module static_pass;
+
+import <cstdint>;
+import <functional>;
+import <string>;
+import <utility>;
+
+import resources;
+
+using namespace wgpu;
+
+// A fullscreen shader whose output depends only on the target size. It is
+// rendered once into a texture that is kept until the size changes or the
+// shader is replaced, frames only sample the texture. The shader provides
+// vs_main (a fullscreen triangle) and fs_main and binds nothing. Content that
+// needs more than one draw comes from SetDraw instead.
+export class StaticPass
+{
+public:
+    // Records the passes that fill the target, it has the given size and is
+    // fully overwritten
+    using DrawFunction = std::function<void(CommandEncoder &, TextureView, uint32_t, uint32_t)>;
+
+    StaticPass(ResourceRegistry &inResources, const char *inLabel) : resources(inResources), label(inLabel) {};
+
+    StaticPass(const StaticPass &) = delete;
+    StaticPass &operator=(const StaticPass &) = delete;
+
+    // Builds the pipeline, again on shader reload. The texture is rendered
+    // again by the next Update. The same source for the same format keeps
+    // the pipeline and the texture.
+    void SetShader(Device &device, const std::string &inSource, TextureFormat inFormat)
+    {
+        if (pipeline && !draw && inFormat == format && inSource == source)
+        {
+            return;
+        }
+
+        resources.Release(pipeline);
+        draw = nullptr;
+        source = inSource;
+        format = inFormat;
+        dirty = true;
+
+        ShaderModuleDescriptor shaderDesc;
+
+#ifdef WEBGPU_BACKEND_WGPU
+        shaderDesc.hintCount = 0;
+        shaderDesc.hints = nullptr;
+#endif
+
+        ShaderModuleWGSLDescriptor shaderCodeDesc{};
+        shaderCodeDesc.chain.next = nullptr;
+        shaderCodeDesc.chain.sType = SType::ShaderModuleWGSLDescriptor;
+        shaderDesc.nextInChain = &shaderCodeDesc.chain;
+        shaderCodeDesc.code = source.c_str();
+        ShaderModule shaderModule = device.createShaderModule(shaderDesc);
+
+        RenderPipelineDescriptor pipelineDesc;
+
+        pipelineDesc.vertex.bufferCount = 0;
+        pipelineDesc.vertex.buffers = nullptr;
+        pipelineDesc.vertex.module = shaderModule;
+        pipelineDesc.vertex.entryPoint = "vs_main";
+        pipelineDesc.vertex.constantCount = 0;
+        pipelineDesc.vertex.constants = nullptr;
+
+        pipelineDesc.primitive.topology = PrimitiveTopology::TriangleList;
+        pipelineDesc.primitive.stripIndexFormat = IndexFormat::Undefined;
+        pipelineDesc.primitive.frontFace = FrontFace::CCW;
+        pipelineDesc.primitive.cullMode = CullMode::None;
+
+        ColorTargetState colorTarget;
+        colorTarget.format = format;
+        colorTarget.blend = nullptr;
+        colorTarget.writeMask = ColorWriteMask::All;
+
+        FragmentState fragmentState;
+        fragmentState.module = shaderModule;
+        fragmentState.entryPoint = "fs_main";
+        fragmentState.constantCount = 0;
+        fragmentState.constants = nullptr;
+        fragmentState.targetCount = 1;
+        fragmentState.targets = &colorTarget;
+        pipelineDesc.fragment = &fragmentState;
+
+        pipelineDesc.depthStencil = nullptr;
+
+        pipelineDesc.multisample.count = 1;
+        pipelineDesc.multisample.mask = ~0u;
+        pipelineDesc.multisample.alphaToCoverageEnabled = false;
+
+        // Nothing is bound, the layout is derived from the shader
+        pipelineDesc.layout = nullptr;
+
+        pipeline = resources.Add(device.createRenderPipeline(pipelineDesc), 0, label);
+
+        shaderModule.release();
+    }
+
+    // Replaces the shader by draw, the texture is rendered again by the next
+    // Update
+    void SetDraw(TextureFormat inFormat, DrawFunction inDraw)
+    {
+        resources.Release(pipeline);
+        draw = std::move(inDraw);
+        source.clear();
+        format = inFormat;
+        dirty = true;
+    }
+
+    // The content changed, the next Update renders it again
+    void Invalidate()
+    {
+        dirty = true;
+    }
+
+    // Renders into the texture when it is missing, of another size or the
+    // content changed, returns whether it did
+    bool Update(Device &device, CommandEncoder &encoder, uint32_t inWidth, uint32_t inHeight)
+    {
+        if ((!pipeline && !draw) || (!dirty && view && inWidth == width && inHeight == height))
+        {
+            return false;
+        }
+
+        if (!view || inWidth != width || inHeight != height)
+        {
+            // Frames still on the GPU may sample the old one
+            resources.Release(view);
+            resources.Release(texture);
+            width = inWidth;
+            height = inHeight;
+
+            TextureDescriptor textureDesc;
+            textureDesc.label = label;
+            textureDesc.dimension = TextureDimension::_2D;
+            textureDesc.format = format;
+            textureDesc.mipLevelCount = 1;
+            textureDesc.sampleCount = 1;
+            textureDesc.size = {width, height, 1};
+            textureDesc.usage = TextureUsage::RenderAttachment | TextureUsage::TextureBinding;
+            textureDesc.viewFormatCount = 1;
+            textureDesc.viewFormats = (WGPUTextureFormat *)&format;
+            texture = resources.CreateTexture(device, textureDesc);
+
+            TextureViewDescriptor viewDesc;
+            viewDesc.aspect = TextureAspect::All;
+            viewDesc.baseArrayLayer = 0;
+            viewDesc.arrayLayerCount = 1;
+            viewDesc.baseMipLevel = 0;
+            viewDesc.mipLevelCount = 1;
+            viewDesc.dimension = TextureViewDimension::_2D;
+            viewDesc.format = format;
+            view = resources.Add(resources.Get(texture).createView(viewDesc), 0, label);
+        }
+
+        dirty = false;
+        renders++;
+
+        if (draw)
+        {
+            draw(encoder, resources.Get(view), width, height);
+            return true;
+        }
+
+        RenderPassColorAttachment colorAttachment = {};
+        colorAttachment.view = resources.Get(view);
+        colorAttachment.resolveTarget = nullptr;
+        colorAttachment.loadOp = LoadOp::Clear;
+        colorAttachment.storeOp = StoreOp::Store;
+        colorAttachment.clearValue = WGPUColor{0.0, 0.0, 0.0, 1.0};
+#ifndef WEBGPU_BACKEND_WGPU
+        colorAttachment.depthSlice = WGPU_DEPTH_SLICE_UNDEFINED;
+#endif // NOT WEBGPU_BACKEND_WGPU
+
+        RenderPassDescriptor passDesc = {};
+        passDesc.colorAttachmentCount = 1;
+        passDesc.colorAttachments = &colorAttachment;
+        passDesc.depthStencilAttachment = nullptr;
+        passDesc.timestampWrites = nullptr;
+
+        RenderPassEncoder pass = encoder.beginRenderPass(passDesc);
+        pass.setPipeline(resources.Get(pipeline));
+        pass.draw(3, 1, 0, 0);
+        pass.end();
+        pass.release();
+        return true;
+    }
+
+    // Empty until the first Update
+    Handle<TextureView> View() const
+    {
+        return view;
+    }
+
+    uint64_t Renders() const
+    {
+        return renders;
+    }
+
+    void Terminate()
+    {
+        draw = nullptr;
+        resources.Release(pipeline);
+        resources.Release(view);
+        resources.Release(texture);
+    }
+
+private:
+    ResourceRegistry &resources;
+    const char *label;
+    Handle<RenderPipeline> pipeline;
+    std::string source;
+    DrawFunction draw;
+    Handle<Texture> texture;
+    Handle<TextureView> view;
+    TextureFormat format = TextureFormat::Undefined;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    bool dirty = true;
+    uint64_t renders = 0;
+};
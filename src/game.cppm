@@ -1,17 +1,26 @@
 export module mygame;
 
 import app;
-import <iostream>;
+import input;
+import logging;
 
 export class Game : public App
 {
 
 protected:
+    virtual void Setup()
+    {
+        forward = input.Action("forward");
+    }
+
     virtual void Tick()
     {
-        if (input.IsDown("forward"))
+        if (input.IsDown(forward))
         {
-            std::cout << "forwardd" << std::endl;
+            LogDebug("forward pressed");
         }
     }
-};
\ No newline at end of file
+
+private:
+    ActionId forward = noAction;
+};
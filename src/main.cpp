@@ -1,10 +1,128 @@
-
+import app;
+import frame_pacing;
+import frame_sync;
 import mygame;
 
-int main()
+import <cmath>;
+import <cstdint>;
+import <filesystem>;
+import <iostream>;
+import <limits>;
+import <stdexcept>;
+import <string>;
+import <string_view>;
+
+// Parses the whole of text as a non-negative number, false when any of it is not one
+template <typename T>
+bool ParseNumber(const std::string &text, T &value)
+{
+	try
+	{
+		size_t end = 0;
+		const double number = std::stod(text, &end);
+		if (end != text.size() || !std::isfinite(number) || number < 0.0 || number > std::numeric_limits<T>::max())
+		{
+			return false;
+		}
+		value = static_cast<T>(number);
+		return value == number;
+	}
+	catch (const std::invalid_argument &)
+	{
+		return false;
+	}
+	catch (const std::out_of_range &)
+	{
+		return false;
+	}
+}
+
+// shadyClient [--record <file>] [--replay <file>] [--frames-in-flight <1-3>]
+//             [--present-mode fifo|relaxed|mailbox|immediate] [--fps <rate>]
+//             [--gpu-budget <ms, 0 renders at full resolution>]
+//             [--logo generated|tiled|shader]
+int main(int argc, char **argv)
 {
 	Game game;
 
+	for (int i = 1; i < argc; i += 2)
+	{
+		const std::string_view option = argv[i];
+		if (i + 1 == argc)
+		{
+			std::cerr << "Missing value for [" << option << "]" << std::endl;
+			return 1;
+		}
+		const std::string value = argv[i + 1];
+
+		if (option == "--frames-in-flight")
+		{
+			if (!ParseNumber(value, game.framesInFlight) || game.framesInFlight < 1 || game.framesInFlight > maxFramesInFlight)
+			{
+				std::cerr << "Frames in flight must be 1 to " << maxFramesInFlight << ", got [" << value << "]" << std::endl;
+				return 1;
+			}
+		}
+		else if (option == "--gpu-budget")
+		{
+			if (!ParseNumber(value, game.resolution.budget))
+			{
+				std::cerr << "Invalid GPU budget [" << value << "]" << std::endl;
+				return 1;
+			}
+		}
+		else if (option == "--fps")
+		{
+			if (!ParseNumber(value, game.targetFrameRate))
+			{
+				std::cerr << "Invalid frame rate [" << value << "]" << std::endl;
+				return 1;
+			}
+		}
+		else if (option == "--logo")
+		{
+			if (value == "shader")
+			{
+				game.logoRenderer = LogoRenderer::Shader;
+			}
+			else if (value == "tiled")
+			{
+				game.logoRenderer = LogoRenderer::Tiled;
+			}
+			else if (value == "generated")
+			{
+				game.logoRenderer = LogoRenderer::Generated;
+			}
+			else
+			{
+				std::cerr << "Unknown logo renderer [" << value << "]" << std::endl;
+				return 1;
+			}
+		}
+		else if (option == "--present-mode")
+		{
+			if (!ParsePresentMode(value, game.presentMode))
+			{
+				std::cerr << "Unknown present mode [" << value << "]" << std::endl;
+				return 1;
+			}
+		}
+		else if (option == "--record" || option == "--replay")
+		{
+			if ((option == "--record" && !game.RecordInput(value)) ||
+				(option == "--replay" && !game.ReplayInput(value)))
+			{
+				std::cerr << "Cannot " << option.substr(2) << " input with [" << value << "]" << std::endl;
+				return 1;
+			}
+		}
+		else
+		{
+			std::cerr << "Unknown option [" << option << "]" << std::endl;
+			return 1;
+		}
+	}
+
 	if (!game.Initialize())
 	{
 		return 1;
@@ -0,0 +1,58 @@
+import logging;
+
+import <chrono>;
+import <cstdint>;
+import <fstream>;
+import <iostream>;
+import <string>;
+
+// Cost of a log call on the calling thread, std::cout with std::endl against
+// the asynchronous logger, both writing to the same file:
+//   shadyLogBench [<messages>] [<output file>]
+int main(int argc, char **argv)
+{
+	using Clock = std::chrono::steady_clock;
+
+	const uint64_t messages = argc > 1 ? std::stoull(argv[1]) : 100000;
+	const std::string path = argc > 2 ? argv[2] : "log_bench.txt";
+	// Below the ring size so the writer keeps up and nothing is dropped
+	constexpr uint64_t burst = 256;
+
+	std::ofstream file(path);
+	if (!file)
+	{
+		std::cerr << "Cannot open [" << path << "]" << std::endl;
+		return 1;
+	}
+
+	std::streambuf *console = std::cout.rdbuf(file.rdbuf());
+
+	const auto coutStart = Clock::now();
+	for (uint64_t i = 0; i < messages; ++i)
+	{
+		std::cout << "Frame " << i << " took " << 16.6 << " ms on " << "main" << std::endl;
+	}
+	const double coutTime = std::chrono::duration<double, std::nano>(Clock::now() - coutStart).count();
+
+	double callTime = 0.0;
+	const auto logStart = Clock::now();
+	for (uint64_t first = 0; first < messages; first += burst)
+	{
+		const auto burstStart = Clock::now();
+		for (uint64_t i = first; i < first + burst && i < messages; ++i)
+		{
+			LogInfo("Frame {} took {} ms on {}", i, 16.6, "main");
+		}
+		callTime += std::chrono::duration<double, std::nano>(Clock::now() - burstStart).count();
+		Logger::Instance().Flush();
+	}
+	const double logTime = std::chrono::duration<double, std::nano>(Clock::now() - logStart).count();
+
+	std::cout.rdbuf(console);
+
+	std::cout << "std::cout + endl: " << coutTime / double(messages) << " ns per message" << std::endl;
+	std::cout << "Logger call:      " << callTime / double(messages) << " ns per message on the caller" << std::endl;
+	std::cout << "Logger written:   " << logTime / double(messages) << " ns per message including the writer thread" << std::endl;
+	std::cout << "Dropped:          " << Logger::Instance().Dropped() << std::endl;
+	return 0;
+}
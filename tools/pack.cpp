@@ -0,0 +1,189 @@
+import archive;
+import asset_io;
+import attributes;
+import compression;
+import jobs;
+import loader;
+import simplify;
+
+import <algorithm>;
+import <chrono>;
+import <cstddef>;
+import <cstdint>;
+import <filesystem>;
+import <iomanip>;
+import <iostream>;
+import <span>;
+import <string>;
+import <string_view>;
+import <vector>;
+
+namespace fs = std::filesystem;
+
+// Times decoding a mesh with every codec this build has, so the choice of
+// compression can be made on our own asset sizes.
+void Benchmark(const std::string &name, const Loader::Mesh &mesh, JobSystem &jobs)
+{
+	using Clock = std::chrono::steady_clock;
+	constexpr int repeats = 20;
+
+	for (Compression codec : {Compression::None, Compression::LZ4, Compression::Zstd})
+	{
+		if (!CompressionAvailable(codec))
+		{
+			continue;
+		}
+
+		const std::vector<std::byte> blob = Loader::WriteMeshBlob(mesh, codec);
+		double best = 1e30;
+		for (int i = 0; i < repeats; ++i)
+		{
+			Loader::Mesh decoded;
+			const auto start = Clock::now();
+			if (!Loader::LoadMeshFromBlob(blob, decoded, jobs))
+			{
+				std::cerr << name << ": " << CompressionName(codec) << " round trip failed" << std::endl;
+				return;
+			}
+			best = std::min(best, std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+		}
+
+		const double rawSize = double(mesh.vertices.size() * sizeof(Loader::VertexAttributes) + mesh.indices.size() * sizeof(uint32_t));
+		std::cout << std::left << std::setw(32) << name << std::setw(6) << CompressionName(codec)
+				  << std::right << std::setw(12) << blob.size() << " bytes"
+				  << std::setw(8) << std::fixed << std::setprecision(2) << rawSize / double(blob.size()) << "x"
+				  << std::setw(10) << std::setprecision(3) << best << " ms"
+				  << std::setw(10) << std::setprecision(0) << rawSize / (best * 1e3) << " MB/s" << std::endl;
+	}
+}
+
+// Packs directories into an asset archive:
+//   shadyPack [--compress none|lz4|zstd] [--bench] <output> <directory> <prefix> [<directory> <prefix> ...]
+// A prefix of "." stores the directory's files at the archive root. OBJ meshes
+// are converted to binary .mesh blobs with generated normals and tangents where
+// the source has none, a LOD chain and meshlets, optionally compressed per chunk.
+int main(int argc, char **argv)
+{
+	Compression compression = Compression::None;
+	bool bench = false;
+
+	int arg = 1;
+	for (; arg < argc && std::string_view(argv[arg]).starts_with("--"); ++arg)
+	{
+		const std::string_view option = argv[arg];
+		if (option == "--bench")
+		{
+			bench = true;
+		}
+		else if (option == "--compress")
+		{
+			if (arg + 1 == argc)
+			{
+				std::cerr << "Missing value for [" << option << "]" << std::endl;
+				return 1;
+			}
+			const std::string_view codec = argv[++arg];
+			if (codec == "none")
+			{
+				compression = Compression::None;
+			}
+			else if (codec == "lz4")
+			{
+				compression = Compression::LZ4;
+			}
+			else if (codec == "zstd")
+			{
+				compression = Compression::Zstd;
+			}
+			else
+			{
+				std::cerr << "Unknown compression [" << codec << "]" << std::endl;
+				return 1;
+			}
+			if (!CompressionAvailable(compression))
+			{
+				std::cerr << "Compression " << codec << " is not available in this build" << std::endl;
+				return 1;
+			}
+		}
+		else
+		{
+			std::cerr << "Unknown option " << option << std::endl;
+			return 1;
+		}
+	}
+
+	if (argc - arg < 3 || (argc - arg) % 2 != 1)
+	{
+		std::cerr << "Usage: " << argv[0] << " [--compress none|lz4|zstd] [--bench] <output> <directory> <prefix> [<directory> <prefix> ...]" << std::endl;
+		return 1;
+	}
+
+	const fs::path output = argv[arg];
+
+	JobSystem jobs;
+	ArchiveWriter writer;
+	uint64_t totalSize = 0;
+
+	for (int i = arg + 1; i < argc; i += 2)
+	{
+		const fs::path root = argv[i];
+		const std::string prefix = argv[i + 1];
+
+		for (const auto &entry : fs::recursive_directory_iterator(root))
+		{
+			if (!entry.is_regular_file())
+			{
+				continue;
+			}
+
+			MappedFile file;
+			if (!file.Open(entry.path()))
+			{
+				std::cerr << "Cannot read [" << entry.path().string() << "]" << std::endl;
+				return 1;
+			}
+
+			fs::path name = entry.path().lexically_relative(root);
+			if (prefix != ".")
+			{
+				name = fs::path(prefix) / name;
+			}
+
+			if (entry.path().extension() == ".obj")
+			{
+				Loader::Mesh mesh;
+				if (!Loader::LoadMeshFromObj(entry.path(), mesh))
+				{
+					return 1;
+				}
+
+				GenerateAttributes(mesh, jobs);
+				BuildLods(mesh);
+
+				if (bench)
+				{
+					Benchmark(name.generic_string(), mesh, jobs);
+				}
+
+				std::vector<std::byte> blob = Loader::WriteMeshBlob(mesh, compression);
+				totalSize += blob.size();
+				writer.Add(name.replace_extension(".mesh").generic_string(), std::move(blob));
+				continue;
+			}
+
+			const auto bytes = file.Bytes();
+			writer.Add(name.generic_string(), std::vector<std::byte>(bytes.begin(), bytes.end()));
+			totalSize += bytes.size();
+		}
+	}
+
+	if (!writer.Write(output))
+	{
+		std::cerr << "Cannot write archive [" << output.string() << "]" << std::endl;
+		return 1;
+	}
+
+	std::cout << "Packed " << writer.Count() << " assets (" << totalSize << " bytes) into " << output.string() << std::endl;
+	return 0;
+}